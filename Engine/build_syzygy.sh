@@ -0,0 +1,22 @@
+#!/bin/bash
+
+# Builds chess_engine with Syzygy tablebase support through Fathom
+# Usage: ./build_syzygy.sh [fathom_dir]
+# Without an argument Fathom is cloned into ./fathom on first use.
+# Check a tablebase directory afterwards with: ./chess_engine tbprobe <SyzygyPath>
+
+set -e
+cd "$(dirname "$0")"
+
+FATHOM_DIR="${1:-fathom}"
+FATHOM_URL="https://github.com/jdart1/Fathom.git"
+
+if [ ! -f "$FATHOM_DIR/src/tbprobe.c" ]; then
+  echo "Fetching Fathom into $FATHOM_DIR"
+  git clone --depth 1 "$FATHOM_URL" "$FATHOM_DIR"
+fi
+
+gcc -std=gnu11 -O2 -march=native -I"$FATHOM_DIR/src" -c "$FATHOM_DIR/src/tbprobe.c" -o tbprobe.o
+g++ -std=c++17 -O2 -march=native -pthread -DUSE_SYZYGY -I"$FATHOM_DIR/src" engine.cpp tbprobe.o -o chess_engine
+
+echo "Built ./chess_engine with Syzygy support"
@@ -4,15 +4,68 @@
 #include <sstream>
 #include <chrono>
 #include <thread>
+#include <atomic>
+#include <memory>
 #include <unordered_map>
 #include <algorithm>
 #include <climits>
+#include <cstdlib>
+#include <random>
+#include <new>
+#include <cmath>
+#include <cstdio>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#endif
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include <cstring>
+#include <cctype>
+#include <fstream>
+#include <string_view>
+#include <charconv>
+
+#ifdef USE_SYZYGY
+#include "tbprobe.h"
+#endif
 
 using namespace chess;
 
 const int MATE_VALUE = 30000;
 const int DRAW_VALUE = 0;
 const int INF = 32000;
+const int MAX_THREADS = 256;
+const int MAX_PLY = 128;
+const int MAX_HASH_MB = 32768;
+const int DELTA_MARGIN = 200;
+const int RFP_DEPTH = 6;
+const int RFP_MARGIN = 80;
+const int RAZOR_DEPTH = 3;
+const int RAZOR_MARGIN = 250;
+const int ASPIRATION_DEPTH = 4;
+const int ASPIRATION_WINDOW = 25;
+const int DEFAULT_MOVES_TO_GO = 30;
+const int DEFAULT_MOVE_OVERHEAD = 30;
+const std::int64_t NO_TIME_LIMIT = std::int64_t(1) << 40;
 
 enum TTFlag {
     TT_EXACT = 0,
@@ -20,708 +73,4416 @@ enum TTFlag {
     TT_BETA = 2
 };
 
-struct TTEntry {
-    std::uint64_t key;
-    Move best_move;
-    int depth;
-    int score;
-    TTFlag flag;
-    
-    TTEntry() : key(0), best_move(Move::NO_MOVE), depth(0), score(0), flag(TT_EXACT) {}
+enum TTAllocation {
+    TT_ALLOC_AUTO = 0,      // explicit huge pages, then transparent huge pages
+    TT_ALLOC_DEFAULT = 1,   // cache-line aligned, no paging hints
+    TT_ALLOC_THP = 2,       // 2MB aligned and madvise(MADV_HUGEPAGE)
+    TT_ALLOC_HUGETLB = 3    // mmap(MAP_HUGETLB) from the reserved huge page pool
 };
 
-class TranspositionTable {
+const char* allocation_name(TTAllocation mode) {
+    switch (mode) {
+        case TT_ALLOC_DEFAULT: return "default";
+        case TT_ALLOC_THP: return "thp";
+        case TT_ALLOC_HUGETLB: return "hugetlb";
+        default: return "auto";
+    }
+}
+
+// Backing memory for the transposition table. Large tables spend most of a
+// probe on TLB misses, so 2MB pages are requested whenever the OS has them;
+// every mode falls back to a plain cache-line aligned allocation.
+class LargePageBuffer {
 private:
-    std::vector<TTEntry> table;
-    size_t size_mask;
+    static const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+    
+    void* memory;
+    size_t bytes;
+    TTAllocation mode;
+    
+    static size_t round_up(size_t size, size_t alignment) {
+        return (size + alignment - 1) / alignment * alignment;
+    }
+    
+    void* try_allocate(size_t size, TTAllocation request) {
+#ifdef __linux__
+        if (request == TT_ALLOC_HUGETLB) {
+            bytes = round_up(size, HUGE_PAGE_SIZE);
+            void* mem = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            return mem == MAP_FAILED ? nullptr : mem;
+        }
+        if (request == TT_ALLOC_THP) {
+            bytes = round_up(size, HUGE_PAGE_SIZE);
+            void* mem = std::aligned_alloc(HUGE_PAGE_SIZE, bytes);
+            if (mem) madvise(mem, bytes, MADV_HUGEPAGE);
+            return mem;
+        }
+#endif
+        if (request == TT_ALLOC_DEFAULT) {
+            bytes = round_up(size, 64);
+            return std::aligned_alloc(64, bytes);
+        }
+        return nullptr;
+    }
     
 public:
-    TranspositionTable(size_t size_mb = 16) {
-        size_t size = (size_mb * 1024 * 1024) / sizeof(TTEntry);
-        size_t actual_size = 1;
-        while (actual_size < size) actual_size <<= 1;
-        
-        table.resize(actual_size);
-        size_mask = actual_size - 1;
+    LargePageBuffer() : memory(nullptr), bytes(0), mode(TT_ALLOC_DEFAULT) {}
+    
+    ~LargePageBuffer() {
+        release();
     }
     
-    void store(std::uint64_t key, Move move, int depth, int score, TTFlag flag) {
-        size_t index = key & size_mask;
-        TTEntry& entry = table[index];
+    LargePageBuffer(const LargePageBuffer&) = delete;
+    LargePageBuffer& operator=(const LargePageBuffer&) = delete;
+    
+    void* allocate(size_t size, TTAllocation request) {
+        release();
         
-        if (entry.key == 0 || entry.depth <= depth || entry.key == key) {
-            entry.key = key;
-            entry.best_move = move;
-            entry.depth = depth;
-            entry.score = score;
-            entry.flag = flag;
+        const TTAllocation order[] = {TT_ALLOC_HUGETLB, TT_ALLOC_THP, TT_ALLOC_DEFAULT};
+        for (TTAllocation candidate : order) {
+            if (request != TT_ALLOC_AUTO && candidate != request && candidate != TT_ALLOC_DEFAULT) continue;
+            
+            memory = try_allocate(size, candidate);
+            if (memory) {
+                mode = candidate;
+                return memory;
+            }
         }
+        throw std::bad_alloc();
     }
     
-    TTEntry* probe(std::uint64_t key) {
-        size_t index = key & size_mask;
-        TTEntry& entry = table[index];
-        
-        if (entry.key == key) {
-            return &entry;
+    void release() {
+        if (!memory) return;
+#ifdef __linux__
+        if (mode == TT_ALLOC_HUGETLB) {
+            munmap(memory, bytes);
+            memory = nullptr;
+            return;
         }
-        return nullptr;
+#endif
+        std::free(memory);
+        memory = nullptr;
     }
     
-    void clear() {
-        std::fill(table.begin(), table.end(), TTEntry());
+    TTAllocation allocation() const {
+        return mode;
     }
 };
 
-class ChessEngine {
+// Unpacked view of a table slot handed out by probe().
+struct TTEntry {
+    Move best_move;
+    int depth;
+    int score;
+    TTFlag flag;
+    
+    TTEntry() : best_move(Move::NO_MOVE), depth(0), score(0), flag(TT_EXACT) {}
+};
+
+// Mate scores are stored relative to the node so they stay valid when the
+// position is reached again at a different ply.
+inline int score_to_tt(int score, int ply) {
+    if (score >= MATE_VALUE - MAX_PLY) return score + ply;
+    if (score <= -MATE_VALUE + MAX_PLY) return score - ply;
+    return score;
+}
+
+inline int score_from_tt(int score, int ply) {
+    if (score >= MATE_VALUE - MAX_PLY) return score - ply;
+    if (score <= -MATE_VALUE + MAX_PLY) return score + ply;
+    return score;
+}
+
+// Info lines come from the search thread while the UCI thread may answer
+// `isready`, so every line goes out whole under one lock.
+std::mutex uci_output_mutex;
+
+void uci_send(const std::string& line) {
+    std::lock_guard<std::mutex> lock(uci_output_mutex);
+    std::cout << line << std::endl;
+}
+
+// UCI score field: centipawns, or moves to mate once a mate is proven.
+std::string format_score(int score) {
+    if (std::abs(score) >= MATE_VALUE - MAX_PLY) {
+        int plies = MATE_VALUE - std::abs(score);
+        int moves = (plies + 1) / 2;
+        return "mate " + std::to_string(score > 0 ? moves : -moves);
+    }
+    return "cp " + std::to_string(score);
+}
+
+// Splits the next whitespace-separated token off the front of `rest`. UCI
+// lines are parsed in place, so no token is copied.
+std::string_view uci_token(std::string_view& rest) {
+    size_t begin = rest.find_first_not_of(" \t\r");
+    if (begin == std::string_view::npos) {
+        rest = {};
+        return {};
+    }
+    size_t end = rest.find_first_of(" \t\r", begin);
+    if (end == std::string_view::npos) end = rest.size();
+    std::string_view token = rest.substr(begin, end - begin);
+    rest.remove_prefix(end);
+    return token;
+}
+
+std::string_view uci_trim(std::string_view text) {
+    size_t begin = text.find_first_not_of(" \t\r");
+    if (begin == std::string_view::npos) return {};
+    size_t end = text.find_last_not_of(" \t\r");
+    return text.substr(begin, end - begin + 1);
+}
+
+// Integer argument of a UCI command; `fallback` if missing or malformed.
+int uci_int(std::string_view& rest, int fallback) {
+    std::string_view token = uci_token(rest);
+    int value = fallback;
+    if (std::from_chars(token.data(), token.data() + token.size(), value).ec != std::errc()) {
+        return fallback;
+    }
+    return value;
+}
+
+// Lockless transposition table made of 64-byte buckets of eight 8-byte slots,
+// so a probe touches a single cache line. Each slot is one atomic word:
+//
+//   bits  0-15  key check: upper 16 key bits XOR the folded payload
+//   bits 16-31  move
+//   bits 32-47  score (int16)
+//   bits 48-55  depth (int8)
+//   bits 56-57  flag
+//   bits 58-63  generation
+//
+// Folding the payload into the check means a slot that another thread is
+// rewriting can never pass verification with a mismatched payload.
+class TranspositionTable {
 private:
-    Board board;
-    TranspositionTable tt;
-    bool stop_search;
-    int nodes_searched;
-    std::chrono::steady_clock::time_point search_start;
-    std::chrono::milliseconds time_limit;
-    
-    static const int piece_values[7];
-    static const int pst_pawn[64];
-    static const int pst_knight[64];
-    static const int pst_bishop[64];
-    static const int pst_rook[64];
-    static const int pst_queen[64];
-    static const int pst_king[64];
-    static const int pst_pawn_endgame[64];
-    static const int pst_king_endgame[64];
+    static const int BUCKET_SLOTS = 8;
+    static const int GENERATION_MASK = 63;
     
-public:
-    ChessEngine() : board(constants::STARTPOS), stop_search(false), nodes_searched(0), time_limit(5000) {}
+    struct alignas(64) Bucket {
+        std::atomic<std::uint64_t> slots[BUCKET_SLOTS];
+    };
     
-    void new_game() {
-        board.setFen(constants::STARTPOS);
-        tt.clear();
+    LargePageBuffer memory;
+    Bucket* buckets;
+    size_t bucket_mask;
+    int generation;
+    
+    static std::uint64_t fold(std::uint64_t payload) {
+        return (payload ^ (payload >> 16) ^ (payload >> 32)) & 0xFFFF;
     }
     
-    void set_position(const std::string& fen) {
-        try {
-            board.setFen(fen);
-        } catch (const std::exception& e) {
-            std::cerr << "Error setting position: " << e.what() << std::endl;
-            board.setFen(constants::STARTPOS);
-        }
+    static std::uint64_t check_of(std::uint64_t key) {
+        return key >> 48;
     }
     
-    void make_move(const std::string& move_str) {
-        try {
-            Move move = uci::uciToMove(board, move_str);
-            if (move != Move::NO_MOVE) {
-                Movelist legal_moves;
-                movegen::legalmoves(legal_moves, board);
-                
-                bool is_legal = false;
-                for (const auto& legal_move : legal_moves) {
-                    if (legal_move == move) {
-                        is_legal = true;
-                        break;
-                    }
-                }
-                
-                if (is_legal) {
-                    board.makeMove(move);
-                } else {
-                    std::cerr << "Illegal move attempted: " << move_str << std::endl;
-                }
-            } else {
-                std::cerr << "Invalid move format: " << move_str << std::endl;
-            }
-        } catch (const std::exception& e) {
-            std::cerr << "Error making move: " << e.what() << std::endl;
-        }
+    static int depth_of(std::uint64_t payload) {
+        return static_cast<std::int8_t>((payload >> 32) & 0xFF);
     }
     
-    bool is_move_legal(const Move& move) const {
-        Movelist legal_moves;
-        movegen::legalmoves(legal_moves, board);
-        
-        for (const auto& legal_move : legal_moves) {
-            if (legal_move == move) {
-                return true;
-            }
-        }
-        return false;
+    static int generation_of(std::uint64_t payload) {
+        return static_cast<int>(payload >> 42) & GENERATION_MASK;
     }
     
-    Move get_first_legal_move() const {
-        Movelist legal_moves;
-        movegen::legalmoves(legal_moves, board);
+    Bucket& bucket_for(std::uint64_t key) {
+        return buckets[key & bucket_mask];
+    }
+    
+public:
+    TranspositionTable(size_t size_mb = 16) : buckets(nullptr), bucket_mask(0), generation(0) {
+        resize(size_mb);
+    }
+    
+    // Rounds down to a power-of-two bucket count so the table never exceeds
+    // the requested size.
+    void resize(size_t size_mb, TTAllocation request = TT_ALLOC_AUTO) {
+        size_t count = std::max<size_t>(1, (size_mb * 1024 * 1024) / sizeof(Bucket));
+        size_t actual_size = 1;
+        while (actual_size * 2 <= count) actual_size <<= 1;
         
-        if (!legal_moves.empty()) {
-            return legal_moves[0];
+        void* mem = memory.allocate(actual_size * sizeof(Bucket), request);
+        buckets = static_cast<Bucket*>(mem);
+        for (size_t b = 0; b < actual_size; ++b) {
+            new (&buckets[b]) Bucket();
         }
-        return Move::NO_MOVE;
+        bucket_mask = actual_size - 1;
+        clear();
     }
     
-    int evaluate() const {
-        if (board.isGameOver().first != GameResultReason::NONE) {
-            auto result = board.isGameOver();
-            if (result.first == GameResultReason::CHECKMATE) {
-                return board.sideToMove() == Color::WHITE ? -MATE_VALUE : MATE_VALUE;
-            }
-            return DRAW_VALUE;
-        }
-        
-        int score = 0;
-        Color stm = board.sideToMove();
+    TTAllocation allocation() const {
+        return memory.allocation();
+    }
+    
+    // Issued right after a move is made so the child's bucket is on its way
+    // into cache by the time the child probes it.
+    void prefetch(std::uint64_t key) const {
+#if defined(__GNUC__) || defined(__clang__)
+        __builtin_prefetch(&buckets[key & bucket_mask]);
+#endif
+    }
+    
+    // Called once per search so entries from earlier searches age out first.
+    void new_search() {
+        generation = (generation + 1) & GENERATION_MASK;
+    }
+    
+    void store(std::uint64_t key, Move move, int depth, int score, TTFlag flag) {
+        Bucket& bucket = bucket_for(key);
+        std::uint64_t check = check_of(key);
         
-        int piece_count = count_pieces();
-        bool is_endgame = piece_count <= 6;
+        int replace = 0;
+        int worst = INT_MAX;
+        std::uint64_t old_payload = 0;
         
-        for (int sq = 0; sq < 64; ++sq) {
-            Square square(sq);
-            Piece piece = board.at(square);
-            
-            if (piece == Piece::NONE) continue;
+        for (int i = 0; i < BUCKET_SLOTS; ++i) {
+            std::uint64_t word = bucket.slots[i].load(std::memory_order_relaxed);
+            std::uint64_t payload = word >> 16;
             
-            Color piece_color = piece.color();
-            PieceType piece_type = piece.type();
-            
-            int piece_value = piece_values[static_cast<int>(piece_type.internal())];
-            int positional_value = 0;
-            
-            int sq_index = piece_color == Color::WHITE ? sq : 63 - sq;
-            
-            switch (piece_type.internal()) {
-                case PieceType::PAWN:
-                    if (is_endgame) {
-                        positional_value = pst_pawn_endgame[sq_index];
-                    } else {
-                        positional_value = pst_pawn[sq_index];
-                    }
-                    break;
-                case PieceType::KNIGHT:
-                    positional_value = pst_knight[sq_index];
-                    break;
-                case PieceType::BISHOP:
-                    positional_value = pst_bishop[sq_index];
-                    break;
-                case PieceType::ROOK:
-                    positional_value = pst_rook[sq_index];
-                    break;
-                case PieceType::QUEEN:
-                    positional_value = pst_queen[sq_index];
-                    break;
-                case PieceType::KING:
-                    if (is_endgame) {
-                        positional_value = pst_king_endgame[sq_index];
-                    } else {
-                        positional_value = pst_king[sq_index];
-                    }
-                    break;
-                default:
-                    break;
+            if (word == 0 || ((word & 0xFFFF) ^ fold(payload)) == check) {
+                replace = i;
+                old_payload = payload;
+                break;
             }
             
-            int total_value = piece_value + positional_value;
-            
-            if (piece_color == Color::WHITE) {
-                score += total_value;
-            } else {
-                score -= total_value;
+            // Prefer the shallowest slot, counting each search of age as 8 plies.
+            int age = (generation - generation_of(payload)) & GENERATION_MASK;
+            int value = depth_of(payload) - 8 * age;
+            if (value < worst) {
+                worst = value;
+                replace = i;
             }
         }
         
-        Bitboard white_pawns = board.pieces(PieceType::PAWN, Color::WHITE);
-        Bitboard black_pawns = board.pieces(PieceType::PAWN, Color::BLACK);
+        bool same_position = old_payload != 0;
+        if (same_position) {
+            // Keep a deeper result for this position unless it is stale or
+            // we now have an exact score.
+            if (flag != TT_EXACT && depth < depth_of(old_payload) &&
+                generation_of(old_payload) == generation) {
+                return;
+            }
+            if (move == Move::NO_MOVE) {
+                move = Move(static_cast<std::uint16_t>(old_payload & 0xFFFF));
+            }
+        }
         
-        score += white_pawns.count() * 10 - black_pawns.count() * 10;
+        std::uint64_t payload = static_cast<std::uint64_t>(move.move())
+                              | static_cast<std::uint64_t>(static_cast<std::uint16_t>(score)) << 16
+                              | static_cast<std::uint64_t>(static_cast<std::uint8_t>(depth)) << 32
+                              | static_cast<std::uint64_t>(flag) << 40
+                              | static_cast<std::uint64_t>(generation) << 42;
         
-        int white_mobility = calculate_mobility(Color::WHITE);
-        int black_mobility = calculate_mobility(Color::BLACK);
-        score += (white_mobility - black_mobility) * 5;
+        bucket.slots[replace].store((payload << 16) | (check ^ fold(payload)), std::memory_order_relaxed);
+    }
+    
+    bool probe(std::uint64_t key, TTEntry& entry) {
+        Bucket& bucket = bucket_for(key);
+        std::uint64_t check = check_of(key);
         
-        if (is_endgame) {
-            Square white_king_sq = board.kingSq(Color::WHITE);
-            Square black_king_sq = board.kingSq(Color::BLACK);
-            if (stm == Color::WHITE) {
-                score += calculate_king_distance_evaluation(white_king_sq, black_king_sq);
-            } else {
-                score += calculate_king_distance_evaluation(black_king_sq, white_king_sq);
+        for (int i = 0; i < BUCKET_SLOTS; ++i) {
+            std::uint64_t word = bucket.slots[i].load(std::memory_order_relaxed);
+            std::uint64_t payload = word >> 16;
+            
+            if (word != 0 && ((word & 0xFFFF) ^ fold(payload)) == check) {
+                entry.best_move = Move(static_cast<std::uint16_t>(payload & 0xFFFF));
+                entry.score = static_cast<std::int16_t>((payload >> 16) & 0xFFFF);
+                entry.depth = depth_of(payload);
+                entry.flag = static_cast<TTFlag>((payload >> 40) & 3);
+                return true;
             }
         }
+        return false;
+    }
+    
+    // Permille of slots written by the current search, sampled over the first
+    // thousand slots as UCI expects.
+    int hashfull() const {
+        const size_t sample = std::min<size_t>(1000 / BUCKET_SLOTS, bucket_mask + 1);
+        int used = 0;
         
-        if (board.inCheck()) {
-            score += board.sideToMove() == Color::WHITE ? -20 : 20;
+        for (size_t b = 0; b < sample; ++b) {
+            for (int i = 0; i < BUCKET_SLOTS; ++i) {
+                std::uint64_t word = buckets[b].slots[i].load(std::memory_order_relaxed);
+                if (word != 0 && generation_of(word >> 16) == generation) {
+                    used++;
+                }
+            }
         }
-        
-        return stm == Color::WHITE ? score : -score;
+        return used * 1000 / static_cast<int>(sample * BUCKET_SLOTS);
     }
     
-    void order_moves(Movelist& moves, Move tt_move) {
-        for (auto& move : moves) {
-            int score = 0;
-            
-            if (move == tt_move) {
-                score = 10000;
-            } else if (board.isCapture(move)) {
-                Piece captured = board.at(move.to());
-                Piece moving = board.at(move.from());
-                
-                score = piece_values[static_cast<int>(captured.type().internal())] - 
-                       piece_values[static_cast<int>(moving.type().internal())] + 1000;
-            } else if (move.typeOf() == Move::PROMOTION) {
-                score = piece_values[static_cast<int>(move.promotionType().internal())] + 500;
-            }
-            
-            Board temp_board = board;
-            temp_board.makeMove(move);
-            if (temp_board.inCheck()) {
-                score += 100;
+    void clear() {
+        for (size_t b = 0; b <= bucket_mask; ++b) {
+            for (int i = 0; i < BUCKET_SLOTS; ++i) {
+                buckets[b].slots[i].store(0, std::memory_order_relaxed);
             }
-            
-            move.setScore(score);
         }
-        
-        std::sort(moves.begin(), moves.end(), [](const Move& a, const Move& b) {
-            return a.score() > b.score();
-        });
+        generation = 0;
     }
+};
+
+// Limits of the current search, written by ChessEngine before the workers start
+// and only read while they run.
+// search_start and infinite are written by the UCI thread on `ponderhit`
+// while the search is running, hence atomic.
+struct SearchLimits {
+    std::atomic<std::chrono::steady_clock::time_point> search_start;
+    std::chrono::milliseconds hard_limit;
+    std::atomic<bool> infinite;
+    std::uint64_t node_limit;   // main worker's nodes; 0 for no limit
+    
+    SearchLimits() : hard_limit(5000), infinite(false), node_limit(0) {}
+};
+
+// Clock state from `go`, in milliseconds; -1 means the field was not sent.
+struct TimeControl {
+    int time = -1;
+    int increment = 0;
+    int moves_to_go = 0;
+    int move_time = -1;
+};
+
+// Splits the clock into a soft limit, checked between iterations, and a hard
+// limit that aborts the search mid-iteration. The soft limit stretches while
+// the best move keeps changing or the score falls, and shrinks once the
+// best move has been stable for a few iterations.
+class TimeManager {
+private:
+    std::int64_t soft_limit;
+    std::int64_t hard_limit;
+    Move last_best_move;
+    int stable_iterations;
+    int last_score;
+    
+public:
+    TimeManager() : soft_limit(NO_TIME_LIMIT), hard_limit(NO_TIME_LIMIT), last_best_move(Move::NO_MOVE),
+                    stable_iterations(0), last_score(0) {}
     
-    int quiescence(int alpha, int beta, int depth = 0) {
-        if (depth > 10) return evaluate();
+    void init(const TimeControl& control, int move_overhead) {
+        last_best_move = Move::NO_MOVE;
+        stable_iterations = 0;
+        last_score = 0;
         
-        nodes_searched++;
-        if (nodes_searched % 1024 == 0) {
-            auto now = std::chrono::steady_clock::now();
-            if (now - search_start > time_limit) {
-                stop_search = true;
-                return alpha;
-            }
+        if (control.move_time >= 0) {
+            soft_limit = hard_limit = std::max<std::int64_t>(control.move_time - move_overhead, 1);
+            return;
+        }
+        if (control.time < 0) {
+            soft_limit = hard_limit = NO_TIME_LIMIT;
+            return;
         }
         
-        int stand_pat = evaluate();
+        std::int64_t remaining = std::max<std::int64_t>(control.time - move_overhead, 1);
+        int moves_to_go = control.moves_to_go > 0 ? std::min(control.moves_to_go, DEFAULT_MOVES_TO_GO)
+                                                  : DEFAULT_MOVES_TO_GO;
+        std::int64_t ideal = remaining / moves_to_go + control.increment * 3 / 4;
         
-        if (stand_pat >= beta) return beta;
-        if (stand_pat > alpha) alpha = stand_pat;
+        hard_limit = std::max<std::int64_t>(std::min(ideal * 3, remaining * 8 / 10), 1);
+        soft_limit = std::min(ideal * 6 / 10, hard_limit);
+    }
+    
+    std::int64_t hard() const {
+        return hard_limit;
+    }
+    
+    // Called after every completed iteration; true when another one is not
+    // worth starting.
+    bool iteration_done(Move best_move, int score, std::int64_t elapsed_ms) {
+        stable_iterations = best_move == last_best_move ? stable_iterations + 1 : 0;
+        int score_drop = last_best_move == Move::NO_MOVE ? 0 : last_score - score;
+        last_best_move = best_move;
+        last_score = score;
         
-        Movelist moves;
-        movegen::legalmoves<movegen::MoveGenType::CAPTURE>(moves, board);
+        if (soft_limit == NO_TIME_LIMIT) return false;
+        
+        double stability = 1.6 - 0.15 * std::min(stable_iterations, 6);
+        double falling = std::clamp(1.0 + score_drop / 100.0, 1.0, 1.5);
+        double scaled = std::min(soft_limit * stability * falling, double(hard_limit));
+        return elapsed_ms >= scaled;
+    }
+};
+
+// Piece values used for move ordering, kept apart from the evaluation's
+// material so changing one does not reorder moves.
+const int ORDER_VALUES[7] = {100, 320, 330, 500, 900, 20000, 0};
+
+// True if a piece of colour `by` attacks `square` on the given occupancy.
+// Pieces on `removed` are treated as already captured.
+inline bool attacked_after(const Board& board, Square square, Color by, Bitboard occupied, Bitboard removed) {
+    Bitboard them = board.us(by) & ~removed;
+    Bitboard diagonal = board.pieces(PieceType::BISHOP, PieceType::QUEEN) & them;
+    Bitboard straight = board.pieces(PieceType::ROOK, PieceType::QUEEN) & them;
+    
+    return (attacks::pawn(~by, square) & board.pieces(PieceType::PAWN) & them) ||
+           (attacks::knight(square) & board.pieces(PieceType::KNIGHT) & them) ||
+           (attacks::king(square) & board.pieces(PieceType::KING) & them) ||
+           (attacks::bishop(square, occupied) & diagonal) ||
+           (attacks::rook(square, occupied) & straight);
+}
+
+// K vs K, a lone minor piece, or bishops that are all on one colour: no mate
+// is possible. Any pawn, rook or queen rules it out at once.
+inline bool insufficient_material(const Board& board) {
+    if (board.pieces(PieceType::PAWN, PieceType::ROOK) || board.pieces(PieceType::QUEEN)) return false;
+    
+    const Bitboard dark_squares(0xAA55AA55AA55AA55ULL);
+    Bitboard bishops = board.pieces(PieceType::BISHOP);
+    int minors = (bishops | board.pieces(PieceType::KNIGHT)).count();
+    if (minors <= 1) return true;
+    
+    return minors == 2 && !board.pieces(PieceType::KNIGHT) &&
+           ((bishops & dark_squares) == bishops || (bishops & ~dark_squares) == bishops);
+}
+
+// Full legality test for a move that may come from another position (TT or
+// killer slots), without generating the move list. Castling is rare enough
+// that it is checked against the generated king moves instead.
+inline bool is_legal_move(const Board& board, Move move) {
+    if (move == Move::NO_MOVE || move == Move::NULL_MOVE) return false;
+    
+    const Color us = board.sideToMove();
+    const Square from = move.from();
+    const Square to = move.to();
+    const Piece piece = board.at(from);
+    
+    if (piece == Piece::NONE || piece.color() != us) return false;
+    
+    const PieceType type = piece.type();
+    
+    if (move.typeOf() == Move::CASTLING) {
+        if (type != PieceType::KING) return false;
+        Movelist king_moves;
+        movegen::legalmoves(king_moves, board, PieceGenType::KING);
+        return std::find(king_moves.begin(), king_moves.end(), move) != king_moves.end();
+    }
+    
+    if (board.us(us).check(to.index())) return false;
+    
+    const Bitboard occupied = board.occ();
+    const Bitboard to_bb = Bitboard::fromSquare(to);
+    Bitboard removed = to_bb;
+    
+    if (type == PieceType::PAWN) {
+        const bool last_rank = to.rank() == (us == Color::WHITE ? Rank::RANK_8 : Rank::RANK_1);
+        if (last_rank != (move.typeOf() == Move::PROMOTION)) return false;
         
-        order_moves(moves, Move::NO_MOVE);
+        const int forward = us == Color::WHITE ? 8 : -8;
+        const bool on_start = from.rank() == (us == Color::WHITE ? Rank::RANK_2 : Rank::RANK_7);
         
-        for (const auto& move : moves) {
-            board.makeMove(move);
-            int score = -quiescence(-beta, -alpha, depth + 1);
-            board.unmakeMove(move);
-            
-            if (stop_search) return alpha;
-            
-            if (score >= beta) return beta;
-            if (score > alpha) alpha = score;
+        if (move.typeOf() == Move::ENPASSANT) {
+            if (to != board.enpassantSq() || !(attacks::pawn(us, from) & to_bb)) return false;
+            removed = Bitboard::fromSquare(to.ep_square());
+        } else if (occupied & to_bb) {
+            if (!(attacks::pawn(us, from) & to_bb)) return false;
+        } else if (to.index() == from.index() + forward) {
+            // single push onto an empty square
+        } else if (on_start && to.index() == from.index() + 2 * forward) {
+            if (occupied.check(from.index() + forward)) return false;
+        } else {
+            return false;
         }
+    } else {
+        if (move.typeOf() != Move::NORMAL) return false;
         
-        return alpha;
+        Bitboard reach;
+        switch (type.internal()) {
+            case PieceType::KNIGHT: reach = attacks::knight(from); break;
+            case PieceType::BISHOP: reach = attacks::bishop(from, occupied); break;
+            case PieceType::ROOK: reach = attacks::rook(from, occupied); break;
+            case PieceType::QUEEN: reach = attacks::queen(from, occupied); break;
+            default: reach = attacks::king(from); break;
+        }
+        if (!(reach & to_bb)) return false;
     }
     
-    int negamax(int depth, int alpha, int beta, bool null_move_allowed = true) {
-        if (stop_search) return alpha;
-        
-        if (depth <= 0) {
-            return quiescence(alpha, beta);
+    // The move is pseudo-legal; it is legal if our king is safe afterwards.
+    Bitboard after = (occupied ^ Bitboard::fromSquare(from) ^ removed) | to_bb;
+    Square king_sq = type == PieceType::KING ? to : board.kingSq(us);
+    return !attacked_after(board, king_sq, ~us, after, removed);
+}
+
+// Least valuable piece of `side` among `attackers`, or PieceType::NONE.
+inline PieceType least_valuable(const Board& board, Bitboard attackers, Color side, Square& from) {
+    const PieceType order[] = {PieceType::PAWN, PieceType::KNIGHT, PieceType::BISHOP,
+                               PieceType::ROOK, PieceType::QUEEN, PieceType::KING};
+    for (PieceType type : order) {
+        Bitboard candidates = attackers & board.pieces(type, side);
+        if (candidates) {
+            from = Square(candidates.lsb());
+            return type;
         }
+    }
+    return PieceType::NONE;
+}
+
+// Static exchange evaluation: material balance of the capture sequence on the
+// move's target square when both sides always recapture with their least
+// valuable piece and may stop whenever continuing would lose. Sliders behind
+// a piece that has captured are discovered by recomputing attacks on the
+// thinned occupancy (x-rays).
+inline int see(const Board& board, Move move) {
+    if (move.typeOf() == Move::CASTLING) return 0;
+    
+    const Square to = move.to();
+    const Square from = move.from();
+    const Color us = board.sideToMove();
+    
+    int gain[32];
+    int d = 0;
+    
+    Bitboard occupied = board.occ() ^ Bitboard::fromSquare(from);
+    int on_square = ORDER_VALUES[static_cast<int>(board.at(from).type().internal())];
+    
+    if (move.typeOf() == Move::ENPASSANT) {
+        gain[0] = ORDER_VALUES[0];
+        occupied ^= Bitboard::fromSquare(to.ep_square());
+    } else {
+        gain[0] = ORDER_VALUES[static_cast<int>(board.at(to).type().internal())];
+    }
+    
+    if (move.typeOf() == Move::PROMOTION) {
+        int promoted = ORDER_VALUES[static_cast<int>(move.promotionType().internal())];
+        gain[0] += promoted - ORDER_VALUES[0];
+        on_square = promoted;
+    }
+    
+    const Bitboard diagonal = board.pieces(PieceType::BISHOP, PieceType::QUEEN);
+    const Bitboard straight = board.pieces(PieceType::ROOK, PieceType::QUEEN);
+    
+    Bitboard attackers = (attacks::pawn(Color::BLACK, to) & board.pieces(PieceType::PAWN, Color::WHITE)) |
+                         (attacks::pawn(Color::WHITE, to) & board.pieces(PieceType::PAWN, Color::BLACK)) |
+                         (attacks::knight(to) & board.pieces(PieceType::KNIGHT)) |
+                         (attacks::king(to) & board.pieces(PieceType::KING)) |
+                         (attacks::bishop(to, occupied) & diagonal) |
+                         (attacks::rook(to, occupied) & straight);
+    attackers &= occupied;
+    
+    Color side = ~us;
+    
+    // gain[d] is speculative: what `side` would net by capturing next. It is
+    // dropped again if no capture follows.
+    while (d < 31) {
+        d++;
+        gain[d] = on_square - gain[d - 1];
+        if (std::max(-gain[d - 1], gain[d]) < 0) break;
         
-        nodes_searched++;
-        if (nodes_searched % 1024 == 0) {
-            auto now = std::chrono::steady_clock::now();
-            if (now - search_start > time_limit) {
-                stop_search = true;
-                return alpha;
-            }
-        }
+        Square attacker_sq;
+        PieceType attacker = least_valuable(board, attackers & board.us(side), side, attacker_sq);
+        if (attacker == PieceType::NONE) break;
         
-        std::uint64_t key = board.hash();
-        TTEntry* tt_entry = tt.probe(key);
-        Move tt_move = Move::NO_MOVE;
+        // A king may only recapture if nothing can take it back.
+        if (attacker == PieceType::KING && (attackers & board.us(~side))) break;
         
-        if (tt_entry && tt_entry->depth >= depth) {
-            if (tt_entry->flag == TT_EXACT) {
-                return tt_entry->score;
-            } else if (tt_entry->flag == TT_ALPHA && tt_entry->score <= alpha) {
-                return alpha;
-            } else if (tt_entry->flag == TT_BETA && tt_entry->score >= beta) {
-                return beta;
-            }
+        on_square = ORDER_VALUES[static_cast<int>(attacker.internal())];
+        occupied ^= Bitboard::fromSquare(attacker_sq);
+        attackers |= (attacks::bishop(to, occupied) & diagonal) | (attacks::rook(to, occupied) & straight);
+        attackers &= occupied;
+        side = ~side;
+    }
+    
+    while (--d) {
+        gain[d - 1] = -std::max(-gain[d - 1], gain[d]);
+    }
+    return gain[0];
+}
+
+// Quiet move ordering tables owned by a search worker and kept across the
+// iterations of one search: two killer slots per ply, a butterfly history
+// indexed [color][from][to], and the quiet reply that last refuted each
+// previous move, indexed [from][to].
+struct SearchHistory {
+    static const int MAX_HISTORY = 16384;
+    
+    Move killers[MAX_PLY][2];
+    Move counter_moves[64][64];
+    int history[2][64][64];
+    
+    SearchHistory() {
+        clear();
+    }
+    
+    void clear() {
+        for (auto& slots : killers) {
+            slots[0] = slots[1] = Move::NO_MOVE;
         }
-        
-        if (tt_entry) {
-            tt_move = tt_entry->best_move;
+        for (auto& row : counter_moves) {
+            std::fill(std::begin(row), std::end(row), Move(Move::NO_MOVE));
+        }
+        std::fill(&history[0][0][0], &history[0][0][0] + 2 * 64 * 64, 0);
+    }
+    
+    // Between the searches of one game. History is halved rather than dropped,
+    // so the next search starts with the old ordering but new cutoffs soon
+    // outweigh it. Killers are stored by ply and the root has moved on by a
+    // move of each side, so they shift down two plies; countermoves do not
+    // depend on the root and stay.
+    void age() {
+        for (int* entry = &history[0][0][0]; entry != &history[0][0][0] + 2 * 64 * 64; ++entry) {
+            *entry /= 2;
         }
+        for (int ply = 0; ply + 2 < MAX_PLY; ++ply) {
+            killers[ply][0] = killers[ply + 2][0];
+            killers[ply][1] = killers[ply + 2][1];
+        }
+        for (int ply = MAX_PLY - 2; ply < MAX_PLY; ++ply) {
+            killers[ply][0] = killers[ply][1] = Move::NO_MOVE;
+        }
+    }
+    
+    int quiet_score(Color color, Move move) const {
+        return history[color][move.from().index()][move.to().index()];
+    }
+    
+    // Gravity keeps every entry inside [-MAX_HISTORY, MAX_HISTORY]: the closer
+    // an entry is to the bound, the less a bonus moves it.
+    void update_history(Color color, Move move, int bonus) {
+        int& entry = history[color][move.from().index()][move.to().index()];
+        entry += bonus - entry * std::abs(bonus) / MAX_HISTORY;
+    }
+    
+    // Called when a quiet move fails high; `tried` are the quiets searched
+    // before it at this node, which get the same amount taken away.
+    void update_quiet_cutoff(Color color, Move move, Move previous, int ply, int depth,
+                             const Move* tried, int tried_count) {
+        int bonus = std::min(depth * depth, 1200);
         
-        if (board.isHalfMoveDraw() || board.isRepetition()) {
-            return DRAW_VALUE;
+        update_history(color, move, bonus);
+        for (int i = 0; i < tried_count; ++i) {
+            update_history(color, tried[i], -bonus);
         }
         
-        auto game_result = board.isGameOver();
-        if (game_result.first != GameResultReason::NONE) {
-            if (game_result.first == GameResultReason::CHECKMATE) {
-                return -MATE_VALUE + nodes_searched;
-            }
-            return DRAW_VALUE;
+        if (killers[ply][0] != move) {
+            killers[ply][1] = killers[ply][0];
+            killers[ply][0] = move;
         }
         
-        if (null_move_allowed && depth >= 3 && !board.inCheck() && 
-            board.hasNonPawnMaterial(board.sideToMove())) {
-            board.makeNullMove();
-            int null_score = -negamax(depth - 1 - 2, -beta, -beta + 1, false);
-            board.unmakeNullMove();
-            
-            if (null_score >= beta) {
+        if (previous != Move::NO_MOVE && previous != Move::NULL_MOVE) {
+            counter_moves[previous.from().index()][previous.to().index()] = move;
+        }
+    }
+};
+
+// Staged move ordering. Moves come out one at a time: first the TT move (only
+// verified, nothing generated), then winning and equal captures by SEE, the
+// two killers, the countermove, the remaining quiets by history, and last the
+// captures that lose material. Each stage is generated when it is reached and
+// picked by partial selection, so a node that cuts off early never generates
+// or scores the rest. Quiescence pickers stop before the losing captures.
+class MovePicker {
+private:
+    enum Stage {
+        STAGE_TT_MOVE,
+        STAGE_GENERATE_CAPTURES,
+        STAGE_CAPTURES,
+        STAGE_KILLER_1,
+        STAGE_KILLER_2,
+        STAGE_COUNTER_MOVE,
+        STAGE_GENERATE_QUIETS,
+        STAGE_QUIETS,
+        STAGE_BAD_CAPTURES,
+        STAGE_DONE
+    };
+    
+    // Capture scores are SEE * 8 plus the victim type as a tie-break; any
+    // score below zero is a losing capture.
+    static const int SEE_CLAMP = 2000;
+    
+    const Board& board;
+    const SearchHistory* history;
+    Move tt_move;
+    Move killer_1;
+    Move killer_2;
+    Move counter_move;
+    bool captures_only;
+    Stage stage;
+    Movelist captures;
+    Movelist quiets;
+    int capture_index;
+    int quiet_index;
+    
+    bool is_special(Move move) const {
+        return move == tt_move || move == killer_1 || move == killer_2 || move == counter_move;
+    }
+    
+    // Killers and countermoves come from other positions, so they are only
+    // played if they are quiet, legal here and not already handed out.
+    bool usable_quiet(Move move) const {
+        return move != Move::NO_MOVE && move != tt_move && !board.isCapture(move) &&
+               move.typeOf() != Move::PROMOTION && is_legal_move(board, move);
+    }
+    
+    void score_captures() {
+        for (auto& move : captures) {
+            int victim = move.typeOf() == Move::ENPASSANT ? 0
+                       : static_cast<int>(board.at(move.to()).type().internal());
+            int exchange = std::clamp(see(board, move), -SEE_CLAMP, SEE_CLAMP);
+            move.setScore(exchange * 8 + victim);
+        }
+    }
+    
+    // History lies within +-MAX_HISTORY, so the promotion and check bonuses
+    // stay inside the int16 move score.
+    void score_quiets() {
+        Color us = board.sideToMove();
+        for (auto& move : quiets) {
+            int score;
+            if (move.typeOf() == Move::PROMOTION) {
+                score = 20000 + ORDER_VALUES[static_cast<int>(move.promotionType().internal())];
+            } else {
+                score = history->quiet_score(us, move);
+                if (board.givesCheck(move) != CheckType::NO_CHECK) {
+                    score += 4096;
+                }
+            }
+            move.setScore(score);
+        }
+    }
+    
+    // Moves the best remaining move to the front of the unpicked range.
+    static Move pick_best(Movelist& moves, int& index) {
+        int best = index;
+        for (int i = index + 1; i < static_cast<int>(moves.size()); ++i) {
+            if (moves[i].score() > moves[best].score()) best = i;
+        }
+        std::swap(moves[index], moves[best]);
+        return moves[index++];
+    }
+    
+public:
+    // Quiescence: captures only, no quiet ordering tables needed.
+    MovePicker(const Board& board, Move tt_move)
+        : board(board), history(nullptr), tt_move(tt_move), killer_1(Move::NO_MOVE), killer_2(Move::NO_MOVE),
+          counter_move(Move::NO_MOVE), captures_only(true), stage(STAGE_TT_MOVE), capture_index(0), quiet_index(0) {}
+    
+    MovePicker(const Board& board, Move tt_move, const SearchHistory& history, int ply, Move previous)
+        : board(board), history(&history), tt_move(tt_move), killer_1(history.killers[ply][0]),
+          killer_2(history.killers[ply][1]), counter_move(Move::NO_MOVE), captures_only(false),
+          stage(STAGE_TT_MOVE), capture_index(0), quiet_index(0) {
+        if (previous != Move::NO_MOVE && previous != Move::NULL_MOVE) {
+            counter_move = history.counter_moves[previous.from().index()][previous.to().index()];
+        }
+    }
+    
+    // Returns Move::NO_MOVE once every move has been handed out.
+    Move next() {
+        switch (stage) {
+            case STAGE_TT_MOVE:
+                stage = STAGE_GENERATE_CAPTURES;
+                if (tt_move != Move::NO_MOVE && (!captures_only || board.isCapture(tt_move)) &&
+                    is_legal_move(board, tt_move)) {
+                    return tt_move;
+                }
+                tt_move = Move::NO_MOVE;
+                [[fallthrough]];
+                
+            case STAGE_GENERATE_CAPTURES:
+                movegen::legalmoves<movegen::MoveGenType::CAPTURE>(captures, board);
+                score_captures();
+                stage = STAGE_CAPTURES;
+                [[fallthrough]];
+                
+            case STAGE_CAPTURES:
+                while (capture_index < static_cast<int>(captures.size())) {
+                    Move move = pick_best(captures, capture_index);
+                    if (move.score() < 0) {
+                        // Everything left loses material; keep it for later.
+                        capture_index--;
+                        break;
+                    }
+                    if (move != tt_move) return move;
+                }
+                if (captures_only) {
+                    stage = STAGE_DONE;
+                    return Move::NO_MOVE;
+                }
+                stage = STAGE_KILLER_1;
+                [[fallthrough]];
+                
+            case STAGE_KILLER_1:
+                stage = STAGE_KILLER_2;
+                if (usable_quiet(killer_1)) return killer_1;
+                killer_1 = Move::NO_MOVE;
+                [[fallthrough]];
+                
+            case STAGE_KILLER_2:
+                stage = STAGE_COUNTER_MOVE;
+                if (killer_2 != killer_1 && usable_quiet(killer_2)) return killer_2;
+                killer_2 = Move::NO_MOVE;
+                [[fallthrough]];
+                
+            case STAGE_COUNTER_MOVE:
+                stage = STAGE_GENERATE_QUIETS;
+                if (counter_move != killer_1 && counter_move != killer_2 && usable_quiet(counter_move)) {
+                    return counter_move;
+                }
+                counter_move = Move::NO_MOVE;
+                [[fallthrough]];
+                
+            case STAGE_GENERATE_QUIETS:
+                movegen::legalmoves<movegen::MoveGenType::QUIET>(quiets, board);
+                score_quiets();
+                stage = STAGE_QUIETS;
+                [[fallthrough]];
+                
+            case STAGE_QUIETS:
+                while (quiet_index < static_cast<int>(quiets.size())) {
+                    Move move = pick_best(quiets, quiet_index);
+                    if (!is_special(move)) return move;
+                }
+                stage = STAGE_BAD_CAPTURES;
+                [[fallthrough]];
+                
+            case STAGE_BAD_CAPTURES:
+                while (capture_index < static_cast<int>(captures.size())) {
+                    Move move = pick_best(captures, capture_index);
+                    if (move != tt_move) return move;
+                }
+                stage = STAGE_DONE;
+                [[fallthrough]];
+                
+            case STAGE_DONE:
+                break;
+        }
+        return Move::NO_MOVE;
+    }
+};
+
+// Material + piece-square sums, white minus black. mg uses the middlegame
+// pawn/king tables and eg the endgame ones; every other piece scores the same
+// in both.
+struct EvalAccumulator {
+    int mg;
+    int eg;
+    
+    EvalAccumulator() : mg(0), eg(0) {}
+};
+
+// Every hand-set number of the PST evaluation, as one flat array of ints so
+// tuners can treat it as a parameter vector. Parameter files (EvalParams
+// option, `tune` and `spsa` output) hold "name value" lines, with names like
+// pst_knight[18] or mobility_weight. Tables are indexed by square from the
+// owner's side: square.index() for white, 63 - index for black.
+struct EvalParams {
+    int piece_values[7] = {100, 320, 330, 500, 900, 20000, 0};
+
+    int pst_pawn[64] = {
+         0,  0,  0,  0,  0,  0,  0,  0,
+        50, 50, 50, 50, 50, 50, 50, 50,
+        10, 10, 20, 30, 30, 20, 10, 10,
+         5,  5, 10, 25, 25, 10,  5,  5,
+         0,  0,  0, 20, 20,  0,  0,  0,
+         5, -5,-10,  0,  0,-10, -5,  5,
+         5, 10, 10,-20,-20, 10, 10,  5,
+         0,  0,  0,  0,  0,  0,  0,  0
+    };
+
+    int pst_knight[64] = {
+        -50,-40,-30,-30,-30,-30,-40,-50,
+        -40,-20,  0,  0,  0,  0,-20,-40,
+        -30,  0, 10, 15, 15, 10,  0,-30,
+        -30,  5, 15, 20, 20, 15,  5,-30,
+        -30,  0, 15, 20, 20, 15,  0,-30,
+        -30,  5, 10, 15, 15, 10,  5,-30,
+        -40,-20,  0,  5,  5,  0,-20,-40,
+        -50,-40,-30,-30,-30,-30,-40,-50
+    };
+
+    int pst_bishop[64] = {
+        -20,-10,-10,-10,-10,-10,-10,-20,
+        -10,  0,  0,  0,  0,  0,  0,-10,
+        -10,  0,  5, 10, 10,  5,  0,-10,
+        -10,  5,  5, 10, 10,  5,  5,-10,
+        -10,  0, 10, 10, 10, 10,  0,-10,
+        -10, 10, 10, 10, 10, 10, 10,-10,
+        -10,  5,  0,  0,  0,  0,  5,-10,
+        -20,-10,-10,-10,-10,-10,-10,-20
+    };
+
+    int pst_rook[64] = {
+         0,  0,  0,  0,  0,  0,  0,  0,
+         5, 10, 10, 10, 10, 10, 10,  5,
+        -5,  0,  0,  0,  0,  0,  0, -5,
+        -5,  0,  0,  0,  0,  0,  0, -5,
+        -5,  0,  0,  0,  0,  0,  0, -5,
+        -5,  0,  0,  0,  0,  0,  0, -5,
+        -5,  0,  0,  0,  0,  0,  0, -5,
+         0,  0,  0,  5,  5,  0,  0,  0
+    };
+
+    int pst_queen[64] = {
+        -20,-10,-10, -5, -5,-10,-10,-20,
+        -10,  0,  0,  0,  0,  0,  0,-10,
+        -10,  0,  5,  5,  5,  5,  0,-10,
+         -5,  0,  5,  5,  5,  5,  0, -5,
+          0,  0,  5,  5,  5,  5,  0, -5,
+        -10,  5,  5,  5,  5,  5,  0,-10,
+        -10,  0,  5,  0,  0,  0,  0,-10,
+        -20,-10,-10, -5, -5,-10,-10,-20
+    };
+
+    int pst_king[64] = {
+        -30,-40,-40,-50,-50,-40,-40,-30,
+        -30,-40,-40,-50,-50,-40,-40,-30,
+        -30,-40,-40,-50,-50,-40,-40,-30,
+        -30,-40,-40,-50,-50,-40,-40,-30,
+        -20,-30,-30,-40,-40,-30,-30,-20,
+        -10,-20,-20,-20,-20,-20,-20,-10,
+         20, 20,  0,  0,  0,  0, 20, 20,
+         20, 30, 10,  0,  0, 10, 30, 20
+    };
+
+    int pst_pawn_endgame[64] = {
+         0,  0,  0,  0,  0,  0,  0,  0,
+        80, 80, 80, 80, 80, 80, 80, 80,
+        60, 60, 60, 60, 60, 60, 60, 60,
+        40, 40, 40, 40, 40, 40, 40, 40,
+        20, 20, 20, 20, 20, 20, 20, 20,
+        10, 10, 10, 10, 10, 10, 10, 10,
+        10, 10, 10, 10, 10, 10, 10, 10,
+         0,  0,  0,  0,  0,  0,  0,  0
+    };
+
+    int pst_king_endgame[64] = {
+        -50,-30,-30,-30,-30,-30,-30,-50,
+        -30,-30,  0,  0,  0,  0,-30,-30,
+        -30,-10, 20, 30, 30, 20,-10,-30,
+        -30,-10, 30, 40, 40, 30,-10,-30,
+        -30,-10, 30, 40, 40, 30,-10,-30,
+        -30,-10, 20, 30, 30, 20,-10,-30,
+        -30,-20,-10,  0,  0,-10,-20,-30,
+        -50,-40,-30,-20,-20,-30,-40,-50
+    };
+
+    int pawn_bonus = 10;
+    int mobility_weight = 5;
+    int check_penalty = 20;
+    int king_distance_weight = 10;
+    
+    static const int COUNT = 7 + 8 * 64 + 4;
+    
+    int* data() { return piece_values; }
+    const int* data() const { return piece_values; }
+    
+    int index_of(const int* field) const {
+        return static_cast<int>(field - data());
+    }
+    
+    // Flat indices of the midgame and endgame table entries for a piece.
+    // Only pawns and kings have separate endgame tables.
+    void pst_entries(PieceType type, int sq_index, int& mg, int& eg) const {
+        const int* tables[6][2] = {{pst_pawn, pst_pawn_endgame}, {pst_knight, pst_knight}, {pst_bishop, pst_bishop},
+                                   {pst_rook, pst_rook}, {pst_queen, pst_queen}, {pst_king, pst_king_endgame}};
+        int t = static_cast<int>(type.internal());
+        mg = index_of(tables[t][0] + sq_index);
+        eg = index_of(tables[t][1] + sq_index);
+    }
+    
+    static std::string name(int index);
+    bool load(const std::string& path, std::string& error);
+    bool save(const std::string& path) const;
+};
+
+static_assert(sizeof(EvalParams) == EvalParams::COUNT * sizeof(int), "EvalParams must stay a flat array of ints");
+
+struct EvalParamField {
+    const char* name;
+    int size;
+};
+
+const EvalParamField EVAL_PARAM_FIELDS[] = {
+    {"piece_values", 7}, {"pst_pawn", 64}, {"pst_knight", 64}, {"pst_bishop", 64}, {"pst_rook", 64},
+    {"pst_queen", 64}, {"pst_king", 64}, {"pst_pawn_endgame", 64}, {"pst_king_endgame", 64},
+    {"pawn_bonus", 1}, {"mobility_weight", 1}, {"check_penalty", 1}, {"king_distance_weight", 1}
+};
+
+std::string EvalParams::name(int index) {
+    for (const EvalParamField& field : EVAL_PARAM_FIELDS) {
+        if (index < field.size) {
+            return field.size == 1 ? field.name : std::string(field.name) + "[" + std::to_string(index) + "]";
+        }
+        index -= field.size;
+    }
+    return "";
+}
+
+// Names missing from the file keep their current value.
+bool EvalParams::load(const std::string& path, std::string& error) {
+    std::ifstream in(path);
+    if (!in) {
+        error = "cannot open " + path;
+        return false;
+    }
+    
+    std::unordered_map<std::string, int> index;
+    for (int i = 0; i < COUNT; ++i) {
+        index[name(i)] = i;
+    }
+    
+    EvalParams loaded = *this;
+    std::string key;
+    int value;
+    while (in >> key >> value) {
+        auto found = index.find(key);
+        if (found == index.end()) {
+            error = "unknown parameter " + key;
+            return false;
+        }
+        loaded.data()[found->second] = value;
+    }
+    if (!in.eof()) {
+        error = "malformed line after " + key;
+        return false;
+    }
+    *this = loaded;
+    return true;
+}
+
+bool EvalParams::save(const std::string& path) const {
+    std::ofstream out(path);
+    for (int i = 0; i < COUNT; ++i) {
+        out << name(i) << " " << data()[i] << "\n";
+    }
+    return static_cast<bool>(out);
+}
+
+// Parameters of the PST evaluation. Changed only between searches (UCI
+// setoption, tuners).
+EvalParams eval_params;
+
+// Knights, bishops, rooks and queens on the board; <= 6 is the endgame.
+inline int count_pieces(const Board& board) {
+    Bitboard non_pawn = board.occ() & ~board.pieces(PieceType::PAWN, PieceType::KING);
+    return non_pawn.count();
+}
+
+// Squares reached by the side's knights, bishops, rooks and queens that
+// hold no friendly piece and are not covered by an enemy pawn. Works for
+// either side regardless of who is to move.
+inline int mobility(const Board& board, Color color) {
+    Bitboard occupied = board.occ();
+    Bitboard enemy_pawns = board.pieces(PieceType::PAWN, ~color);
+    Bitboard pawn_attacks = color == Color::WHITE
+        ? attacks::pawnLeftAttacks<Color::BLACK>(enemy_pawns) | attacks::pawnRightAttacks<Color::BLACK>(enemy_pawns)
+        : attacks::pawnLeftAttacks<Color::WHITE>(enemy_pawns) | attacks::pawnRightAttacks<Color::WHITE>(enemy_pawns);
+    Bitboard safe = ~(board.us(color) | pawn_attacks);
+    
+    int count = 0;
+    
+    Bitboard knights = board.pieces(PieceType::KNIGHT, color);
+    while (knights) {
+        count += (attacks::knight(Square(knights.pop())) & safe).count();
+    }
+    
+    Bitboard bishops = board.pieces(PieceType::BISHOP, color);
+    while (bishops) {
+        count += (attacks::bishop(Square(bishops.pop()), occupied) & safe).count();
+    }
+    
+    Bitboard rooks = board.pieces(PieceType::ROOK, color);
+    while (rooks) {
+        count += (attacks::rook(Square(rooks.pop()), occupied) & safe).count();
+    }
+    
+    Bitboard queens = board.pieces(PieceType::QUEEN, color);
+    while (queens) {
+        count += (attacks::queen(Square(queens.pop()), occupied) & safe).count();
+    }
+    
+    return count;
+}
+
+// Endgame term before weighting: opponent king far from the centre, kings
+// close together.
+inline int king_distance_term(Square friendly_king_sq, Square opponent_king_sq) {
+    int friendly_file = friendly_king_sq.file();
+    int friendly_rank = friendly_king_sq.rank();
+    int opponent_file = opponent_king_sq.file();
+    int opponent_rank = opponent_king_sq.rank();
+
+    int opponentKingDstToCentreFile = std::max(3 - opponent_file, opponent_file - 4);
+    int opponentKingDstToCentreRank = std::max(3 - opponent_rank, opponent_rank - 4);
+    int opponentKingDstFromCentre = opponentKingDstToCentreFile + opponentKingDstToCentreRank;
+
+    int dstBetweenKingsFile = std::abs(friendly_file - opponent_file);
+    int dstBetweenKingsRank = std::abs(friendly_rank - opponent_rank);
+    int dstBetweenKings = dstBetweenKingsFile + dstBetweenKingsRank;
+
+    int evaluation = 0;
+    evaluation += opponentKingDstFromCentre;
+    evaluation += 14 - dstBetweenKings;
+    return evaluation;
+}
+
+// NNUE evaluation with the HalfKP feature set: every (own king square,
+// non-king piece, square) triple from each side's point of view, 41024
+// features per side. The first layer is kept per side as an accumulator
+// and updated as pieces move; then 2x256 -> 32 -> 32 -> 1 with clipped
+// ReLUs. Networks use the Stockfish 12 .nnue layout
+// (halfkp_256x2-32-32), so existing nets of that generation load directly.
+const int NNUE_HALF = 256;
+const int NNUE_FEATURES = 64 * 641;
+const int NNUE_L1 = 32;
+const int NNUE_L2 = 32;
+const std::uint32_t NNUE_VERSION = 0x7AF32F16;
+
+struct alignas(64) NNUEAccumulator {
+    std::int16_t values[2][NNUE_HALF];  // [perspective][neuron]
+};
+
+// A piece entering (sign 1) or leaving (sign -1) a square.
+struct PieceDelta {
+    Piece piece;
+    Square square;
+    int sign;
+};
+
+// Dot product of clipped activations with one row of int8 weights. n is a
+// multiple of 32 and both pointers are 32-byte aligned.
+inline std::int32_t dot_u8_i8(const std::uint8_t* input, const std::int8_t* weights, int n) {
+#if defined(__AVX2__)
+    const __m256i ones = _mm256_set1_epi16(1);
+    __m256i sum = _mm256_setzero_si256();
+    for (int i = 0; i < n; i += 32) {
+        __m256i a = _mm256_load_si256(reinterpret_cast<const __m256i*>(input + i));
+        __m256i b = _mm256_load_si256(reinterpret_cast<const __m256i*>(weights + i));
+        sum = _mm256_add_epi32(sum, _mm256_madd_epi16(_mm256_maddubs_epi16(a, b), ones));
+    }
+    __m128i half = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+    half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0x4E));
+    half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0xB1));
+    return _mm_cvtsi128_si32(half);
+#elif defined(__SSSE3__)
+    const __m128i ones = _mm_set1_epi16(1);
+    __m128i sum = _mm_setzero_si128();
+    for (int i = 0; i < n; i += 16) {
+        __m128i a = _mm_load_si128(reinterpret_cast<const __m128i*>(input + i));
+        __m128i b = _mm_load_si128(reinterpret_cast<const __m128i*>(weights + i));
+        sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_maddubs_epi16(a, b), ones));
+    }
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4E));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xB1));
+    return _mm_cvtsi128_si32(sum);
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    // Activations are at most 127, so they can be read as signed bytes.
+    int32x4_t sum = vdupq_n_s32(0);
+    for (int i = 0; i < n; i += 16) {
+        int8x16_t a = vreinterpretq_s8_u8(vld1q_u8(input + i));
+        int8x16_t b = vld1q_s8(weights + i);
+        int16x8_t products = vmull_s8(vget_low_s8(a), vget_low_s8(b));
+        products = vmlal_s8(products, vget_high_s8(a), vget_high_s8(b));
+        sum = vpadalq_s16(sum, products);
+    }
+    return vaddvq_s32(sum);
+#else
+    std::int32_t sum = 0;
+    for (int i = 0; i < n; ++i) {
+        sum += static_cast<std::int32_t>(input[i]) * weights[i];
+    }
+    return sum;
+#endif
+}
+
+// Adds (sign 1) or subtracts (sign -1) one feature row to an accumulator
+// half. Both pointers are 64-byte aligned. Only 16-bit adds are needed, so
+// every x86-64 build has a vector path.
+inline void accumulate_row(std::int16_t* values, const std::int16_t* row, int sign) {
+#if defined(__AVX2__)
+    __m256i* v = reinterpret_cast<__m256i*>(values);
+    const __m256i* r = reinterpret_cast<const __m256i*>(row);
+    if (sign > 0) {
+        for (int i = 0; i < NNUE_HALF / 16; ++i) v[i] = _mm256_add_epi16(v[i], _mm256_load_si256(r + i));
+    } else {
+        for (int i = 0; i < NNUE_HALF / 16; ++i) v[i] = _mm256_sub_epi16(v[i], _mm256_load_si256(r + i));
+    }
+#elif defined(__SSE2__)
+    __m128i* v = reinterpret_cast<__m128i*>(values);
+    const __m128i* r = reinterpret_cast<const __m128i*>(row);
+    if (sign > 0) {
+        for (int i = 0; i < NNUE_HALF / 8; ++i) v[i] = _mm_add_epi16(v[i], _mm_load_si128(r + i));
+    } else {
+        for (int i = 0; i < NNUE_HALF / 8; ++i) v[i] = _mm_sub_epi16(v[i], _mm_load_si128(r + i));
+    }
+#elif defined(__ARM_NEON)
+    if (sign > 0) {
+        for (int i = 0; i < NNUE_HALF; i += 8) vst1q_s16(values + i, vaddq_s16(vld1q_s16(values + i), vld1q_s16(row + i)));
+    } else {
+        for (int i = 0; i < NNUE_HALF; i += 8) vst1q_s16(values + i, vsubq_s16(vld1q_s16(values + i), vld1q_s16(row + i)));
+    }
+#else
+    if (sign > 0) {
+        for (int i = 0; i < NNUE_HALF; ++i) values[i] += row[i];
+    } else {
+        for (int i = 0; i < NNUE_HALF; ++i) values[i] -= row[i];
+    }
+#endif
+}
+
+// Clipped ReLU of one accumulator half into [0, 127]: max with zero, then a
+// saturating pack to bytes caps the top. Both pointers are 32-byte aligned.
+inline void clipped_relu_i16(const std::int16_t* values, std::uint8_t* output) {
+#if defined(__AVX2__)
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i* v = reinterpret_cast<const __m256i*>(values);
+    __m256i* out = reinterpret_cast<__m256i*>(output);
+    for (int i = 0; i < NNUE_HALF / 32; ++i) {
+        __m256i a = _mm256_max_epi16(_mm256_load_si256(v + 2 * i), zero);
+        __m256i b = _mm256_max_epi16(_mm256_load_si256(v + 2 * i + 1), zero);
+        // packs works within 128-bit lanes; the permute restores the order.
+        _mm256_store_si256(out + i, _mm256_permute4x64_epi64(_mm256_packs_epi16(a, b), 0xD8));
+    }
+#elif defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i* v = reinterpret_cast<const __m128i*>(values);
+    __m128i* out = reinterpret_cast<__m128i*>(output);
+    for (int i = 0; i < NNUE_HALF / 16; ++i) {
+        __m128i a = _mm_max_epi16(_mm_load_si128(v + 2 * i), zero);
+        __m128i b = _mm_max_epi16(_mm_load_si128(v + 2 * i + 1), zero);
+        _mm_store_si128(out + i, _mm_packs_epi16(a, b));
+    }
+#elif defined(__ARM_NEON)
+    const int16x8_t zero = vdupq_n_s16(0);
+    for (int i = 0; i < NNUE_HALF; i += 16) {
+        int8x8_t a = vqmovn_s16(vmaxq_s16(vld1q_s16(values + i), zero));
+        int8x8_t b = vqmovn_s16(vmaxq_s16(vld1q_s16(values + i + 8), zero));
+        vst1q_u8(output + i, vreinterpretq_u8_s8(vcombine_s8(a, b)));
+    }
+#else
+    for (int i = 0; i < NNUE_HALF; ++i) {
+        output[i] = static_cast<std::uint8_t>(std::clamp<int>(values[i], 0, 127));
+    }
+#endif
+}
+
+class NNUENetwork {
+private:
+    LargePageBuffer buffer;
+    std::int16_t* feature_biases;
+    std::int16_t* feature_weights;  // [feature][neuron]
+    std::int32_t* l1_biases;
+    std::int8_t* l1_weights;        // [output][input]
+    std::int32_t* l2_biases;
+    std::int8_t* l2_weights;
+    std::int32_t* out_bias;
+    std::int8_t* out_weights;
+    
+    // Parses the file image into 64-byte aligned arrays in one buffer.
+    bool parse(const char* data, size_t size, std::string& error) {
+        size_t offset = 0;
+        auto read = [&](void* target, size_t bytes) {
+            if (offset + bytes > size) return false;
+            std::memcpy(target, data + offset, bytes);
+            offset += bytes;
+            return true;
+        };
+        
+        std::uint32_t version, hash, description_size;
+        if (!read(&version, 4) || !read(&hash, 4) || !read(&description_size, 4) || version != NNUE_VERSION) {
+            error = "not a HalfKP NNUE file";
+            return false;
+        }
+        offset += description_size;
+        
+        size_t sizes[] = {
+            NNUE_HALF * sizeof(std::int16_t), size_t(NNUE_FEATURES) * NNUE_HALF * sizeof(std::int16_t),
+            NNUE_L1 * sizeof(std::int32_t), NNUE_L1 * 2 * NNUE_HALF,
+            NNUE_L2 * sizeof(std::int32_t), NNUE_L2 * NNUE_L1,
+            sizeof(std::int32_t), NNUE_L2
+        };
+        size_t starts[8];
+        size_t total = 0;
+        for (int i = 0; i < 8; ++i) {
+            starts[i] = total;
+            total += (sizes[i] + 63) / 64 * 64;
+        }
+        char* base = static_cast<char*>(buffer.allocate(total, TT_ALLOC_AUTO));
+        feature_biases = reinterpret_cast<std::int16_t*>(base + starts[0]);
+        feature_weights = reinterpret_cast<std::int16_t*>(base + starts[1]);
+        l1_biases = reinterpret_cast<std::int32_t*>(base + starts[2]);
+        l1_weights = reinterpret_cast<std::int8_t*>(base + starts[3]);
+        l2_biases = reinterpret_cast<std::int32_t*>(base + starts[4]);
+        l2_weights = reinterpret_cast<std::int8_t*>(base + starts[5]);
+        out_bias = reinterpret_cast<std::int32_t*>(base + starts[6]);
+        out_weights = reinterpret_cast<std::int8_t*>(base + starts[7]);
+        
+        // Each block of the file starts with a 32-bit structure hash.
+        bool ok = read(&hash, 4) && read(feature_biases, sizes[0]) && read(feature_weights, sizes[1]) &&
+                  read(&hash, 4) && read(l1_biases, sizes[2]) && read(l1_weights, sizes[3]) &&
+                  read(l2_biases, sizes[4]) && read(l2_weights, sizes[5]) &&
+                  read(out_bias, sizes[6]) && read(out_weights, sizes[7]);
+        if (!ok || offset != size) {
+            error = "unexpected file size for halfkp_256x2-32-32";
+            buffer.release();
+            return false;
+        }
+        return true;
+    }
+    
+    static int feature_index(Color perspective, Square king, Piece piece, Square square) {
+        int orient = perspective == Color::WHITE ? 0 : 63;
+        int type = static_cast<int>(piece.type().internal());
+        int piece_index = 1 + (type * 2 + (piece.color() == perspective ? 0 : 1)) * 64;
+        return (square.index() ^ orient) + piece_index + 641 * (king.index() ^ orient);
+    }
+    
+    void add_feature(std::int16_t* values, int feature, int sign) const {
+        accumulate_row(values, feature_weights + size_t(feature) * NNUE_HALF, sign);
+    }
+    
+public:
+    // The file is mapped rather than read through a stream; its blocks are
+    // not aligned for vector loads, so they are copied once into the
+    // network's own buffer and the mapping is dropped. All threads share the
+    // one copy.
+    bool load(const std::string& path, std::string& error) {
+#ifdef __linux__
+        int fd = open(path.c_str(), O_RDONLY);
+        struct stat info;
+        if (fd < 0 || fstat(fd, &info) != 0) {
+            if (fd >= 0) close(fd);
+            error = "cannot open " + path;
+            return false;
+        }
+        size_t size = static_cast<size_t>(info.st_size);
+        void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (data == MAP_FAILED) {
+            error = "cannot map " + path;
+            return false;
+        }
+        bool ok = parse(static_cast<const char*>(data), size, error);
+        munmap(data, size);
+        return ok;
+#else
+        std::ifstream in(path, std::ios::binary);
+        if (!in) {
+            error = "cannot open " + path;
+            return false;
+        }
+        std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        return parse(data.data(), data.size(), error);
+#endif
+    }
+    
+    void refresh(const Board& board, Color perspective, NNUEAccumulator& acc) const {
+        std::int16_t* values = acc.values[perspective == Color::WHITE ? 0 : 1];
+        std::memcpy(values, feature_biases, sizeof(acc.values[0]));
+        
+        Square king = board.kingSq(perspective);
+        Bitboard pieces = board.occ() & ~board.pieces(PieceType::KING);
+        while (pieces) {
+            Square square(pieces.pop());
+            add_feature(values, feature_index(perspective, king, board.at(square), square), 1);
+        }
+    }
+    
+    // Copies the parent accumulator for one side and applies the move's
+    // piece changes. Kings are not features, so the deltas skip them.
+    void update(const NNUEAccumulator& parent, NNUEAccumulator& acc, Color perspective, Square king,
+                const PieceDelta* deltas, int count) const {
+        int side = perspective == Color::WHITE ? 0 : 1;
+        std::memcpy(acc.values[side], parent.values[side], sizeof(acc.values[0]));
+        for (int i = 0; i < count; ++i) {
+            if (deltas[i].piece.type() == PieceType::KING) continue;
+            add_feature(acc.values[side], feature_index(perspective, king, deltas[i].piece, deltas[i].square),
+                        deltas[i].sign);
+        }
+    }
+    
+    // Score in centipawns from the side to move's point of view.
+    int evaluate(const NNUEAccumulator& acc, Color stm) const {
+        alignas(64) std::uint8_t input[2 * NNUE_HALF];
+        alignas(64) std::uint8_t hidden1[NNUE_L1];
+        alignas(64) std::uint8_t hidden2[NNUE_L2];
+        
+        const int order[2] = {stm == Color::WHITE ? 0 : 1, stm == Color::WHITE ? 1 : 0};
+        for (int p = 0; p < 2; ++p) {
+            clipped_relu_i16(acc.values[order[p]], input + p * NNUE_HALF);
+        }
+        
+        for (int o = 0; o < NNUE_L1; ++o) {
+            std::int32_t sum = l1_biases[o] + dot_u8_i8(input, l1_weights + o * 2 * NNUE_HALF, 2 * NNUE_HALF);
+            hidden1[o] = static_cast<std::uint8_t>(std::clamp(sum >> 6, 0, 127));
+        }
+        for (int o = 0; o < NNUE_L2; ++o) {
+            std::int32_t sum = l2_biases[o] + dot_u8_i8(hidden1, l2_weights + o * NNUE_L1, NNUE_L1);
+            hidden2[o] = static_cast<std::uint8_t>(std::clamp(sum >> 6, 0, 127));
+        }
+        std::int32_t output = out_bias[0] + dot_u8_i8(hidden2, out_weights, NNUE_L2);
+        
+        // Output / 16 is in Stockfish's internal units, where a pawn is 208.
+        return output / 16 * 100 / 208;
+    }
+};
+
+// Syzygy tablebases through Fathom (https://github.com/jdart1/Fathom), built
+// in with -DUSE_SYZYGY and tbprobe.c compiled alongside this file;
+// build_syzygy.sh fetches Fathom into fathom/ and does both. Fathom only
+// scans the directory in tb_init and maps a table file the first time a
+// position needs it, so a large SyzygyPath does not slow down startup. Without
+// the flag every probe fails and the search never sees a tablebase score.
+const int TB_WIN_VALUE = MATE_VALUE - 2 * MAX_PLY;
+const int TB_PROBE_DEPTH = 2;
+
+class Tablebases {
+public:
+    // Loads every table found under `path` (directories separated by ':').
+    // An empty path or "<empty>" unloads them.
+    static bool init(const std::string& path) {
+#ifdef USE_SYZYGY
+        if (path.empty() || path == "<empty>") {
+            tb_free();
+            return true;
+        }
+        return tb_init(path.c_str());
+#else
+        (void)path;
+        return false;
+#endif
+    }
+    
+    static int largest() {
+#ifdef USE_SYZYGY
+        return static_cast<int>(TB_LARGEST);
+#else
+        return 0;
+#endif
+    }
+    
+    // SyzygyProbeLimit: positions with more pieces than this are not probed.
+    static void set_probe_limit(int limit) {
+        probe_limit = limit;
+    }
+    
+    static int cardinality() {
+        return std::min(probe_limit, largest());
+    }
+    
+    // WDL probe for the search. Fathom only answers with no castling rights and
+    // a fresh 50-move counter, where the table result is exact. Cursed wins and
+    // blessed losses are draws under the 50-move rule.
+    static bool probe_wdl(const Board& board, int ply, int& score) {
+#ifdef USE_SYZYGY
+        if (board.halfMoveClock() != 0 || !board.castlingRights().isEmpty()) return false;
+        unsigned result = tb_probe_wdl(board.us(Color::WHITE).getBits(), board.us(Color::BLACK).getBits(),
+                                       board.pieces(PieceType::KING).getBits(), board.pieces(PieceType::QUEEN).getBits(),
+                                       board.pieces(PieceType::ROOK).getBits(), board.pieces(PieceType::BISHOP).getBits(),
+                                       board.pieces(PieceType::KNIGHT).getBits(), board.pieces(PieceType::PAWN).getBits(),
+                                       0, 0, ep_square(board), board.sideToMove() == Color::WHITE);
+        if (result == TB_RESULT_FAILED) return false;
+        
+        score = result == TB_WIN ? TB_WIN_VALUE - ply
+              : result == TB_LOSS ? -TB_WIN_VALUE + ply
+              : DRAW_VALUE;
+        return true;
+#else
+        (void)board; (void)ply; (void)score;
+        return false;
+#endif
+    }
+    
+    // DTZ probe at the root: the move that keeps the best result and, within
+    // it, resets the 50-move counter soonest, with a score for the info line.
+    static bool probe_root(const Board& board, Move& move, int& score) {
+#ifdef USE_SYZYGY
+        if (!board.castlingRights().isEmpty() || board.occ().count() > cardinality()) return false;
+        unsigned result = tb_probe_root(board.us(Color::WHITE).getBits(), board.us(Color::BLACK).getBits(),
+                                        board.pieces(PieceType::KING).getBits(), board.pieces(PieceType::QUEEN).getBits(),
+                                        board.pieces(PieceType::ROOK).getBits(), board.pieces(PieceType::BISHOP).getBits(),
+                                        board.pieces(PieceType::KNIGHT).getBits(), board.pieces(PieceType::PAWN).getBits(),
+                                        board.halfMoveClock(), 0, ep_square(board), board.sideToMove() == Color::WHITE,
+                                        nullptr);
+        if (result == TB_RESULT_FAILED || result == TB_RESULT_CHECKMATE || result == TB_RESULT_STALEMATE) return false;
+        
+        static const PieceType promotions[] = {PieceType::NONE, PieceType::QUEEN, PieceType::ROOK,
+                                               PieceType::BISHOP, PieceType::KNIGHT};
+        Square from(static_cast<int>(TB_GET_FROM(result)));
+        Square to(static_cast<int>(TB_GET_TO(result)));
+        PieceType promotion = promotions[TB_GET_PROMOTES(result)];
+        
+        Movelist moves;
+        movegen::legalmoves(moves, board);
+        for (Move candidate : moves) {
+            bool promotes = candidate.typeOf() == Move::PROMOTION;
+            if (candidate.from() == from && candidate.to() == to &&
+                (promotes ? candidate.promotionType() == promotion : promotion == PieceType::NONE)) {
+                unsigned wdl = TB_GET_WDL(result);
+                int dtz = static_cast<int>(TB_GET_DTZ(result));
+                move = candidate;
+                score = wdl == TB_WIN ? TB_WIN_VALUE - dtz
+                      : wdl == TB_LOSS ? -TB_WIN_VALUE + dtz
+                      : DRAW_VALUE;
+                return true;
+            }
+        }
+        return false;
+#else
+        (void)board; (void)move; (void)score;
+        return false;
+#endif
+    }
+    
+private:
+#ifdef USE_SYZYGY
+    static unsigned ep_square(const Board& board) {
+        Square ep = board.enpassantSq();
+        return ep == Square::NO_SQ ? 0 : static_cast<unsigned>(ep.index());
+    }
+#endif
+    
+    static int probe_limit;
+};
+
+int Tablebases::probe_limit = 7;
+
+// Polyglot opening book (.bin): 16-byte big-endian entries sorted by key.
+// chess-library's Zobrist keys use the Polyglot random table and encoding
+// (en passant only when a capture is possible), so board.hash() is the book
+// key as is. The file stays mapped and is searched in place.
+class PolyglotBook {
+private:
+    static const size_t ENTRY_SIZE = 16;
+    
+    const unsigned char* data;
+    size_t size;
+#ifndef __linux__
+    std::string contents;
+#endif
+    std::mt19937_64 rng;
+    
+    static std::uint64_t read_be(const unsigned char* bytes, int count) {
+        std::uint64_t value = 0;
+        for (int i = 0; i < count; ++i) {
+            value = (value << 8) | bytes[i];
+        }
+        return value;
+    }
+    
+    std::uint64_t key_at(size_t index) const {
+        return read_be(data + index * ENTRY_SIZE, 8);
+    }
+    
+    // Polyglot packs to/from as file + 8 * rank in 6 bits each, promotion in
+    // bits 12-14 (1 = knight .. 4 = queen), and castling as king takes own
+    // rook, which is also how chess-library encodes castling moves.
+    static Move decode(const Board& board, std::uint16_t raw) {
+        static const PieceType promotions[] = {PieceType::NONE, PieceType::KNIGHT, PieceType::BISHOP,
+                                               PieceType::ROOK, PieceType::QUEEN};
+        Square to(raw & 0x3F);
+        Square from((raw >> 6) & 0x3F);
+        int promotion = (raw >> 12) & 0x7;
+        if (promotion > 4) return Move::NO_MOVE;
+        
+        Movelist moves;
+        movegen::legalmoves(moves, board);
+        for (Move move : moves) {
+            bool promotes = move.typeOf() == Move::PROMOTION;
+            if (move.from() == from && move.to() == to &&
+                (promotes ? move.promotionType() == promotions[promotion] : promotion == 0)) {
+                return move;
+            }
+        }
+        return Move::NO_MOVE;
+    }
+    
+public:
+    PolyglotBook() : data(nullptr), size(0), rng(std::random_device{}()) {}
+    
+    ~PolyglotBook() {
+#ifdef __linux__
+        if (data) munmap(const_cast<unsigned char*>(data), size);
+#endif
+    }
+    
+    PolyglotBook(const PolyglotBook&) = delete;
+    PolyglotBook& operator=(const PolyglotBook&) = delete;
+    
+    bool load(const std::string& path, std::string& error) {
+#ifdef __linux__
+        int fd = open(path.c_str(), O_RDONLY);
+        struct stat info;
+        if (fd < 0 || fstat(fd, &info) != 0) {
+            if (fd >= 0) close(fd);
+            error = "cannot open " + path;
+            return false;
+        }
+        size = static_cast<size_t>(info.st_size);
+        if (size < ENTRY_SIZE || size % ENTRY_SIZE != 0) {
+            close(fd);
+            error = path + " is not a Polyglot book";
+            return false;
+        }
+        void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapped == MAP_FAILED) {
+            error = "cannot map " + path;
+            return false;
+        }
+        data = static_cast<const unsigned char*>(mapped);
+#else
+        std::ifstream in(path, std::ios::binary);
+        if (!in) {
+            error = "cannot open " + path;
+            return false;
+        }
+        contents.assign((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        size = contents.size();
+        if (size < ENTRY_SIZE || size % ENTRY_SIZE != 0) {
+            error = path + " is not a Polyglot book";
+            return false;
+        }
+        data = reinterpret_cast<const unsigned char*>(contents.data());
+#endif
+        return true;
+    }
+    
+    size_t entries() const {
+        return size / ENTRY_SIZE;
+    }
+    
+    // Picks among the entries for this position with probability proportional
+    // to their weight. NO_MOVE when the position is not in the book.
+    Move probe(const Board& board) {
+        std::uint64_t key = board.hash();
+        size_t low = 0, high = entries();
+        while (low < high) {
+            size_t mid = low + (high - low) / 2;
+            if (key_at(mid) < key) low = mid + 1;
+            else high = mid;
+        }
+        
+        std::uint32_t total = 0;
+        size_t end = low;
+        for (; end < entries() && key_at(end) == key; ++end) {
+            total += static_cast<std::uint32_t>(read_be(data + end * ENTRY_SIZE + 10, 2));
+        }
+        if (end == low) return Move::NO_MOVE;
+        
+        // A line whose weights are all zero is still playable, uniformly.
+        std::uint64_t pick = rng() % (total ? total : end - low);
+        for (size_t i = low; i < end; ++i) {
+            const unsigned char* entry = data + i * ENTRY_SIZE;
+            std::uint32_t weight = total ? static_cast<std::uint32_t>(read_be(entry + 10, 2)) : 1;
+            if (pick < weight) {
+                return decode(board, static_cast<std::uint16_t>(read_be(entry + 8, 2)));
+            }
+            pick -= weight;
+        }
+        return Move::NO_MOVE;
+    }
+};
+
+// Late move reductions indexed [depth][move number], filled once at startup:
+// log(depth) * log(move) so that late moves at high depth lose the most.
+int LMR_REDUCTIONS[64][64];
+
+void init_search_tables() {
+    for (int depth = 1; depth < 64; ++depth) {
+        for (int move = 1; move < 64; ++move) {
+            LMR_REDUCTIONS[depth][move] = static_cast<int>(0.75 + std::log(depth) * std::log(move) / 2.25);
+        }
+    }
+}
+
+// Search counters, compiled in with -DSEARCH_STATS. In a normal build
+// SEARCH_STAT() expands to nothing, so the counters stay at zero and cost
+// nothing in the search.
+#ifdef SEARCH_STATS
+#define SEARCH_STAT(expr) (stats.expr)
+#else
+#define SEARCH_STAT(expr) ((void)0)
+#endif
+
+struct SearchStats {
+    std::uint64_t tt_probes = 0;
+    std::uint64_t tt_hits = 0;
+    std::uint64_t tt_cutoffs[3] = {0, 0, 0};  // indexed by TTFlag
+    std::uint64_t beta_cutoffs = 0;
+    std::uint64_t first_move_cutoffs = 0;
+    std::uint64_t null_tries = 0;
+    std::uint64_t null_cutoffs = 0;
+    std::uint64_t main_nodes = 0;
+    std::uint64_t qsearch_nodes = 0;
+    
+    SearchStats& operator+=(const SearchStats& other) {
+        tt_probes += other.tt_probes;
+        tt_hits += other.tt_hits;
+        for (int i = 0; i < 3; ++i) tt_cutoffs[i] += other.tt_cutoffs[i];
+        beta_cutoffs += other.beta_cutoffs;
+        first_move_cutoffs += other.first_move_cutoffs;
+        null_tries += other.null_tries;
+        null_cutoffs += other.null_cutoffs;
+        main_nodes += other.main_nodes;
+        qsearch_nodes += other.qsearch_nodes;
+        return *this;
+    }
+};
+
+// Percentage with an empty denominator reading as 0.
+double percent(std::uint64_t part, std::uint64_t whole) {
+    return whole ? 100.0 * part / whole : 0.0;
+}
+
+// Branching factor per depth from the node totals after each iteration.
+std::vector<double> branching_factors(const std::vector<std::uint64_t>& iteration_nodes) {
+    std::vector<double> factors;
+    for (size_t d = 2; d < iteration_nodes.size(); ++d) {
+        double previous = static_cast<double>(iteration_nodes[d - 1] - iteration_nodes[d - 2]);
+        double current = static_cast<double>(iteration_nodes[d] - iteration_nodes[d - 1]);
+        factors.push_back(previous > 0 ? current / previous : 0.0);
+    }
+    return factors;
+}
+
+// Depth skipping for Lazy SMP helpers. Helper i uses entry (i - 1) % 20 and
+// skips every depth d where ((d + SKIP_PHASE) / SKIP_SIZE) is odd, so the
+// helpers spread over runs of 1 to 4 depths, each at a different offset.
+const int SKIP_SIZE[20] = {1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4};
+const int SKIP_PHASE[20] = {0, 1, 0, 1, 2, 3, 0, 1, 2, 3, 4, 5, 0, 1, 2, 3, 4, 5, 6, 7};
+
+// One searcher of the Lazy SMP pool. Every worker owns its board and node
+// counter; the transposition table, stop flag and limits are shared.
+class SearchWorker {
+private:
+    Board board;
+    TranspositionTable& tt;
+    std::atomic<bool>& stop_search;
+    const SearchLimits& limits;
+    const int thread_id;
+    std::atomic<std::uint64_t> nodes_searched;
+    std::atomic<std::uint64_t> tb_hits;
+    Move root_best_move;
+    
+    SearchHistory heuristics;
+    Move played[MAX_PLY + 1];
+    
+    // Triangular PV: row `ply` holds the best line found from that ply, in
+    // pv_table[ply][ply .. pv_length[ply]).
+    Move pv_table[MAX_PLY + 1][MAX_PLY + 1];
+    int pv_length[MAX_PLY + 1];
+    
+    // One accumulator per made move; unmaking a move just drops back a slot.
+    EvalAccumulator accumulators[MAX_PLY + 16];
+    int acc_top;
+    
+    // With a network loaded, evaluation goes through NNUE and these
+    // accumulators follow the same stack; otherwise the PST evaluation runs.
+    const NNUENetwork* network;
+    NNUEAccumulator nnue_accumulators[MAX_PLY + 16];
+    
+    SearchStats stats;
+    
+public:
+    SearchWorker(TranspositionTable& tt, std::atomic<bool>& stop_search, const SearchLimits& limits, int thread_id)
+        : tt(tt), stop_search(stop_search), limits(limits), thread_id(thread_id),
+          nodes_searched(0), tb_hits(0), root_best_move(Move::NO_MOVE), acc_top(0), network(nullptr) {}
+    
+    void set_network(const NNUENetwork* net) {
+        network = net;
+    }
+    
+    void reset(const Board& root) {
+        board = root;
+        nodes_searched.store(0, std::memory_order_relaxed);
+        tb_hits.store(0, std::memory_order_relaxed);
+        root_best_move = Move::NO_MOVE;
+        heuristics.age();
+        stats = SearchStats();
+        refresh_accumulator();
+    }
+    
+    // Move ordering is kept from one search to the next; a new game starts
+    // from nothing.
+    void clear_history() {
+        heuristics.clear();
+    }
+    
+    const SearchStats& search_stats() const {
+        return stats;
+    }
+    
+    void refresh_accumulator() {
+        acc_top = 0;
+        accumulators[0] = EvalAccumulator();
+        Bitboard occupied = board.occ();
+        while (occupied) {
+            Square square(occupied.pop());
+            add_piece(accumulators[0], board.at(square), square, 1);
+        }
+        
+        if (network) {
+            network->refresh(board, Color::WHITE, nnue_accumulators[0]);
+            network->refresh(board, Color::BLACK, nnue_accumulators[0]);
+        }
+    }
+    
+    // Walks every legal line to `depth` through make_move and compares the
+    // incrementally updated NNUE accumulator with a full refresh at each
+    // node. Returns the number of nodes where they differ.
+    std::uint64_t verify_accumulators(int depth, std::uint64_t& checked) {
+        NNUEAccumulator fresh;
+        network->refresh(board, Color::WHITE, fresh);
+        network->refresh(board, Color::BLACK, fresh);
+        checked++;
+        std::uint64_t mismatches = std::memcmp(&fresh, &nnue_accumulators[acc_top], sizeof(fresh)) != 0;
+        if (depth == 0) return mismatches;
+        
+        Movelist moves;
+        movegen::legalmoves(moves, board);
+        for (const Move move : moves) {
+            make_move(move);
+            mismatches += verify_accumulators(depth - 1, checked);
+            unmake_move(move);
+        }
+        return mismatches;
+    }
+    
+    static void add_piece(EvalAccumulator& acc, Piece piece, Square square, int sign) {
+        int sq_index = piece.color() == Color::WHITE ? square.index() : 63 - square.index();
+        int value = eval_params.piece_values[static_cast<int>(piece.type().internal())];
+        int mg_index, eg_index;
+        eval_params.pst_entries(piece.type(), sq_index, mg_index, eg_index);
+        int mg = value + eval_params.data()[mg_index];
+        int eg = value + eval_params.data()[eg_index];
+        
+        if (piece.color() == Color::BLACK) sign = -sign;
+        acc.mg += sign * mg;
+        acc.eg += sign * eg;
+    }
+    
+    // Applies the move's piece deltas to a fresh accumulator, then plays it.
+    void make_move(Move move) {
+        EvalAccumulator& acc = accumulators[acc_top + 1];
+        acc = accumulators[acc_top];
+        acc_top++;
+        
+        PieceDelta deltas[4];
+        int count = 0;
+        auto change = [&](Piece piece, Square square, int sign) {
+            add_piece(acc, piece, square, sign);
+            deltas[count++] = PieceDelta{piece, square, sign};
+        };
+        
+        Color us = board.sideToMove();
+        Piece moving = board.at(move.from());
+        
+        if (move.typeOf() == Move::CASTLING) {
+            bool king_side = move.to() > move.from();
+            Piece rook = board.at(move.to());
+            change(moving, move.from(), -1);
+            change(rook, move.to(), -1);
+            change(moving, Square::castling_king_square(king_side, us), 1);
+            change(rook, Square::castling_rook_square(king_side, us), 1);
+        } else {
+            Piece captured = board.at(move.to());
+            if (captured != Piece::NONE) {
+                change(captured, move.to(), -1);
+            } else if (move.typeOf() == Move::ENPASSANT) {
+                change(Piece(PieceType::PAWN, ~us), move.to().ep_square(), -1);
+            }
+            
+            change(moving, move.from(), -1);
+            if (move.typeOf() == Move::PROMOTION) {
+                change(Piece(move.promotionType(), us), move.to(), 1);
+            } else {
+                change(moving, move.to(), 1);
+            }
+        }
+        
+        board.makeMove(move);
+        
+        if (network) {
+            // A king move changes every feature of its own side: rebuild that
+            // half, update the other one.
+            const NNUEAccumulator& parent = nnue_accumulators[acc_top - 1];
+            NNUEAccumulator& next = nnue_accumulators[acc_top];
+            for (Color side : {Color::WHITE, Color::BLACK}) {
+                if (side == us && moving.type() == PieceType::KING) {
+                    network->refresh(board, side, next);
+                } else {
+                    network->update(parent, next, side, board.kingSq(side), deltas, count);
+                }
+            }
+        }
+    }
+    
+    void unmake_move(Move move) {
+        board.unmakeMove(move);
+        acc_top--;
+    }
+    
+    std::uint64_t nodes() const {
+        return nodes_searched.load(std::memory_order_relaxed);
+    }
+    
+    std::uint64_t tablebase_hits() const {
+        return tb_hits.load(std::memory_order_relaxed);
+    }
+    
+    Move best_move() const {
+        return root_best_move;
+    }
+    
+    std::vector<Move> principal_variation() const {
+        return std::vector<Move>(&pv_table[0][0], &pv_table[0][0] + pv_length[0]);
+    }
+    
+    void update_pv(int ply, Move move) {
+        pv_table[ply][ply] = move;
+        for (int i = ply + 1; i < pv_length[ply + 1]; ++i) {
+            pv_table[ply][i] = pv_table[ply + 1][i];
+        }
+        pv_length[ply] = std::max(pv_length[ply + 1], ply + 1);
+    }
+    
+    // Only the main worker polls the clock; helpers stop when it raises the flag.
+    void count_node() {
+        std::uint64_t nodes = nodes_searched.load(std::memory_order_relaxed) + 1;
+        nodes_searched.store(nodes, std::memory_order_relaxed);
+        
+        if (thread_id == 0 && limits.node_limit && nodes >= limits.node_limit) {
+            stop_search.store(true, std::memory_order_relaxed);
+        }
+        if (thread_id == 0 && nodes % 1024 == 0 && !limits.infinite.load(std::memory_order_relaxed)) {
+            auto now = std::chrono::steady_clock::now();
+            if (now - limits.search_start.load(std::memory_order_relaxed) > limits.hard_limit) {
+                stop_search.store(true, std::memory_order_relaxed);
+            }
+        }
+    }
+    
+    bool stopped() const {
+        return stop_search.load(std::memory_order_relaxed);
+    }
+    
+    int evaluate() const {
+        if (network) return network->evaluate(nnue_accumulators[acc_top], board.sideToMove());
+        return evaluate_classical();
+    }
+    
+    int evaluate_classical() const {
+        const EvalAccumulator& acc = accumulators[acc_top];
+        Color stm = board.sideToMove();
+        
+        int piece_count = count_pieces(board);
+        bool is_endgame = piece_count <= 6;
+        
+        int score = is_endgame ? acc.eg : acc.mg;
+        
+        Bitboard white_pawns = board.pieces(PieceType::PAWN, Color::WHITE);
+        Bitboard black_pawns = board.pieces(PieceType::PAWN, Color::BLACK);
+        
+        score += (white_pawns.count() - black_pawns.count()) * eval_params.pawn_bonus;
+        
+        int white_mobility = mobility(board, Color::WHITE);
+        int black_mobility = mobility(board, Color::BLACK);
+        score += (white_mobility - black_mobility) * eval_params.mobility_weight;
+        
+        if (is_endgame) {
+            Square white_king_sq = board.kingSq(Color::WHITE);
+            Square black_king_sq = board.kingSq(Color::BLACK);
+            if (stm == Color::WHITE) {
+                score += king_distance_term(white_king_sq, black_king_sq) * eval_params.king_distance_weight;
+            } else {
+                score += king_distance_term(black_king_sq, white_king_sq) * eval_params.king_distance_weight;
+            }
+        }
+        
+        if (board.inCheck()) {
+            score += board.sideToMove() == Color::WHITE ? -eval_params.check_penalty : eval_params.check_penalty;
+        }
+        
+        return stm == Color::WHITE ? score : -score;
+    }
+    
+    // Negamax hands over here at depth 0 without testing for mate, so a side
+    // in check may not stand pat: it searches every evasion, and having none
+    // is mate.
+    int quiescence(int alpha, int beta, int ply, int depth = 0) {
+        bool in_check = board.inCheck();
+        if (depth > 10 || (in_check && ply >= MAX_PLY)) return evaluate();
+        
+        count_node();
+        SEARCH_STAT(qsearch_nodes++);
+        if (stopped()) return alpha;
+        
+        int stand_pat = -INF;
+        if (!in_check) {
+            stand_pat = evaluate();
+            if (stand_pat >= beta) return beta;
+            if (stand_pat > alpha) alpha = stand_pat;
+        }
+        
+        // Out of check the picker only hands out captures and drops the ones
+        // that lose material (SEE < 0); in check it hands out every move.
+        MovePicker picker = in_check ? MovePicker(board, Move::NO_MOVE, heuristics, ply, Move::NO_MOVE)
+                                     : MovePicker(board, Move::NO_MOVE);
+        int moves_searched = 0;
+        
+        for (Move move = picker.next(); move != Move::NO_MOVE; move = picker.next()) {
+            moves_searched++;
+            // Delta pruning: even winning the victim outright cannot lift the
+            // score to alpha.
+            if (!in_check && move.typeOf() != Move::PROMOTION) {
+                int victim = move.typeOf() == Move::ENPASSANT ? ORDER_VALUES[0]
+                           : ORDER_VALUES[static_cast<int>(board.at(move.to()).type().internal())];
+                if (stand_pat + victim + DELTA_MARGIN <= alpha) continue;
+            }
+            
+            make_move(move);
+            int score = -quiescence(-beta, -alpha, ply + 1, depth + 1);
+            unmake_move(move);
+            
+            if (stopped()) return alpha;
+            
+            if (score >= beta) return beta;
+            if (score > alpha) alpha = score;
+        }
+        
+        if (in_check && moves_searched == 0) return -MATE_VALUE + ply;
+        return alpha;
+    }
+    
+    int negamax(int depth, int alpha, int beta, int ply, bool null_move_allowed = true) {
+        pv_length[ply] = ply;
+        if (stopped()) return alpha;
+        
+        if (depth <= 0) {
+            return quiescence(alpha, beta, ply);
+        }
+        
+        count_node();
+        SEARCH_STAT(main_nodes++);
+        if (stopped()) return alpha;
+        if (ply >= MAX_PLY) return evaluate();
+        
+        bool root = ply == 0;
+        bool pv_node = beta - alpha > 1;
+        std::uint64_t key = board.hash();
+        TTEntry tt_entry;
+        bool tt_hit = tt.probe(key, tt_entry);
+        Move tt_move = Move::NO_MOVE;
+        SEARCH_STAT(tt_probes++);
+        SEARCH_STAT(tt_hits += tt_hit);
+        
+        // Never cut at the root, where the worker has to come back with its
+        // own move, or anywhere on the PV, where a cutoff would return before
+        // update_pv and cut the printed line short.
+        if (!root && !pv_node && tt_hit && tt_entry.depth >= depth) {
+            int tt_score = score_from_tt(tt_entry.score, ply);
+            if (tt_entry.flag == TT_EXACT) {
+                SEARCH_STAT(tt_cutoffs[TT_EXACT]++);
+                return tt_score;
+            } else if (tt_entry.flag == TT_ALPHA && tt_score <= alpha) {
+                SEARCH_STAT(tt_cutoffs[TT_ALPHA]++);
+                return alpha;
+            } else if (tt_entry.flag == TT_BETA && tt_score >= beta) {
+                SEARCH_STAT(tt_cutoffs[TT_BETA]++);
+                return beta;
+            }
+        }
+        
+        if (tt_hit) {
+            tt_move = tt_entry.best_move;
+        }
+        
+        // Draws that need no move generation. isRepetition() only looks back
+        // over the reversible moves since the last capture or pawn move, and
+        // mate and stalemate fall out of the move loop below, which finds no
+        // legal move, so the full game-over test is not needed here.
+        if (!root && (board.isHalfMoveDraw() || insufficient_material(board) || board.isRepetition())) {
+            return DRAW_VALUE;
+        }
+        
+        // A tablebase result is exact, so it ends the node. With exactly as
+        // many pieces as the probe limit, shallow nodes are left to the search.
+        int tb_pieces = Tablebases::cardinality();
+        if (!root && tb_pieces > 0) {
+            int pieces = board.occ().count();
+            int tb_score;
+            if ((pieces < tb_pieces || (pieces == tb_pieces && depth >= TB_PROBE_DEPTH)) &&
+                Tablebases::probe_wdl(board, ply, tb_score)) {
+                tb_hits.store(tb_hits.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                tt.store(key, Move::NO_MOVE, std::min(depth + 6, MAX_PLY - 1), score_to_tt(tb_score, ply), TT_EXACT);
+                return tb_score;
+            }
+        }
+        
+        bool in_check = board.inCheck();
+        bool mate_window = std::abs(beta) >= MATE_VALUE - MAX_PLY || std::abs(alpha) >= MATE_VALUE - MAX_PLY;
+        
+        // Shallow static pruning, never in check or on the PV.
+        if (!pv_node && !in_check && !mate_window) {
+            int static_eval = evaluate();
+            
+            // Reverse futility: already so far above beta that a few plies
+            // will not bring it back.
+            if (depth <= RFP_DEPTH && static_eval - RFP_MARGIN * depth >= beta) {
+                return beta;
+            }
+            
+            // Razoring: hopelessly below alpha, so only tactics can help.
+            if (depth <= RAZOR_DEPTH && static_eval + RAZOR_MARGIN * depth <= alpha) {
+                int razor_score = quiescence(alpha, beta, ply);
+                if (razor_score <= alpha) return razor_score;
+            }
+        }
+        
+        if (null_move_allowed && depth >= 3 && !in_check && 
+            board.hasNonPawnMaterial(board.sideToMove())) {
+            played[ply] = Move::NULL_MOVE;
+            board.makeNullMove();
+            int null_score = -negamax(depth - 1 - 2, -beta, -beta + 1, ply + 1, false);
+            board.unmakeNullMove();
+            SEARCH_STAT(null_tries++);
+            
+            if (null_score >= beta) {
+                SEARCH_STAT(null_cutoffs++);
+                return beta;
+            }
+        }
+        
+        Move previous = root ? Move(Move::NO_MOVE) : played[ply - 1];
+        MovePicker picker(board, tt_move, heuristics, ply, previous);
+        
+        int best_score = -INF;
+        Move best_move = Move::NO_MOVE;
+        TTFlag flag = TT_ALPHA;
+        int moves_searched = 0;
+        Move quiets_tried[64];
+        int quiet_count = 0;
+        
+        for (Move move = picker.next(); move != Move::NO_MOVE; move = picker.next()) {
+            int i = moves_searched++;
+            bool quiet = !board.isCapture(move) && move.typeOf() != Move::PROMOTION;
+            
+            played[ply] = move;
+            make_move(move);
+            tt.prefetch(board.hash());
+            
+            int score;
+            if (i == 0) {
+                score = -negamax(depth - 1, -beta, -alpha, ply + 1, true);
+            } else {
+                // Late quiet moves get a reduced null-window search first and
+                // are re-searched at full depth only if they beat alpha.
+                int reduction = 0;
+                if (depth >= 3 && i >= 2 && quiet && !in_check && !board.inCheck()) {
+                    reduction = LMR_REDUCTIONS[std::min(depth, 63)][std::min(i, 63)];
+                    if (pv_node) reduction--;
+                    reduction = std::clamp(reduction, 0, depth - 2);
+                }
+                
+                score = -negamax(depth - 1 - reduction, -alpha - 1, -alpha, ply + 1, true);
+                if (score > alpha && reduction > 0) {
+                    score = -negamax(depth - 1, -alpha - 1, -alpha, ply + 1, true);
+                }
+                if (score > alpha && score < beta) {
+                    score = -negamax(depth - 1, -beta, -alpha, ply + 1, true);
+                }
+            }
+            
+            unmake_move(move);
+            
+            if (stopped()) return alpha;
+            
+            if (score > best_score) {
+                best_score = score;
+                best_move = move;
+            }
+            
+            // Only moves that raise alpha are trusted at the root, so a failed
+            // low aspiration search keeps the previous iteration's move.
+            if (score > alpha) {
+                update_pv(ply, move);
+                if (root) root_best_move = move;
+            }
+            
+            if (score >= beta) {
+                SEARCH_STAT(beta_cutoffs++);
+                SEARCH_STAT(first_move_cutoffs += i == 0);
+                if (quiet) {
+                    heuristics.update_quiet_cutoff(board.sideToMove(), move, previous, ply, depth,
+                                                   quiets_tried, quiet_count);
+                }
+                tt.store(key, best_move, depth, score_to_tt(beta, ply), TT_BETA);
                 return beta;
             }
+            
+            if (score > alpha) {
+                alpha = score;
+                flag = TT_EXACT;
+            }
+            
+            if (quiet && quiet_count < 64) {
+                quiets_tried[quiet_count++] = move;
+            }
+        }
+        
+        if (moves_searched == 0) {
+            return board.inCheck() ? -MATE_VALUE + ply : DRAW_VALUE;
+        }
+        
+        tt.store(key, best_move, depth, score_to_tt(best_score, ply), flag);
+        return best_score;
+    }
+    
+    
+    // Searches a window around the previous iteration's score, widening it on
+    // the failing side until the score lands inside.
+    int aspiration_search(int depth, int previous_score) {
+        int delta = ASPIRATION_WINDOW;
+        int alpha = -INF;
+        int beta = INF;
+        
+        if (depth >= ASPIRATION_DEPTH && std::abs(previous_score) < MATE_VALUE - MAX_PLY) {
+            alpha = std::max(previous_score - delta, -INF);
+            beta = std::min(previous_score + delta, INF);
+        }
+        
+        while (true) {
+            int score = negamax(depth, alpha, beta, 0);
+            if (stopped()) return score;
+            
+            if (score <= alpha) {
+                beta = (alpha + beta) / 2;
+                alpha = std::max(score - delta, -INF);
+            } else if (score >= beta) {
+                beta = std::min(score + delta, INF);
+            } else {
+                return score;
+            }
+            delta += delta;
+        }
+    }
+    
+    // Helper loop: each helper skips the depths its SKIP_SIZE/SKIP_PHASE entry
+    // rules out, so the pool is spread over several depths at once.
+    void iterative_deepening(int max_depth) {
+        const int skip = (thread_id - 1) % 20;
+        int score = 0;
+        for (int depth = 1; depth <= max_depth && !stopped(); ++depth) {
+            if (((depth + SKIP_PHASE[skip]) / SKIP_SIZE[skip]) % 2) continue;
+            score = aspiration_search(depth, score);
+        }
+    }
+};
+
+class ChessEngine {
+private:
+    Board board;
+    TranspositionTable tt;
+    std::atomic<bool> stop_search;
+    SearchLimits limits;
+    std::vector<std::unique_ptr<SearchWorker>> workers;
+    std::vector<std::uint64_t> depth_nodes;
+    bool silent;
+    std::thread search_thread;
+    Move ponder_move;
+    TimeManager time_manager;
+    int move_overhead;
+    std::unique_ptr<NNUENetwork> network;
+    std::unique_ptr<PolyglotBook> book;
+    bool own_book;
+    int search_score;
+    
+    // The last `position` as sent: base FEN and the moves played on it.
+    std::string position_fen;
+    std::string position_moves;
+    
+public:
+    ChessEngine() : board(constants::STARTPOS), stop_search(false), silent(false), ponder_move(Move::NO_MOVE),
+                    move_overhead(DEFAULT_MOVE_OVERHEAD), own_book(false), search_score(0) {
+        set_threads(1);
+    }
+    
+    ~ChessEngine() {
+        stop();
+        wait();
+    }
+    
+    // Benchmarks and tools search without printing info lines.
+    void set_silent(bool value) {
+        silent = value;
+    }
+    
+    // Total nodes after each completed iteration of the last search.
+    const std::vector<std::uint64_t>& iteration_nodes() const {
+        return depth_nodes;
+    }
+    
+    void set_threads(int count) {
+        count = std::clamp(count, 1, MAX_THREADS);
+        workers.clear();
+        for (int i = 0; i < count; ++i) {
+            workers.push_back(std::make_unique<SearchWorker>(tt, stop_search, limits, i));
+            workers.back()->set_network(network.get());
+        }
+    }
+    
+    // EvalFile: an empty path (or "<empty>") goes back to the PST evaluation.
+    // A file that fails to load leaves the current evaluation in place.
+    bool load_network(const std::string& path, std::string& error) {
+        std::unique_ptr<NNUENetwork> loaded;
+        if (!path.empty() && path != "<empty>") {
+            loaded = std::make_unique<NNUENetwork>();
+            if (!loaded->load(path, error)) return false;
+        }
+        network = std::move(loaded);
+        for (auto& worker : workers) {
+            worker->set_network(network.get());
+        }
+        return true;
+    }
+    
+    // BookFile: like EvalFile, an empty path unloads the book and a file that
+    // fails to load keeps the current one.
+    bool load_book(const std::string& path, std::string& error) {
+        std::unique_ptr<PolyglotBook> loaded;
+        if (!path.empty() && path != "<empty>") {
+            loaded = std::make_unique<PolyglotBook>();
+            if (!loaded->load(path, error)) return false;
+        }
+        book = std::move(loaded);
+        return true;
+    }
+    
+    size_t book_entries() const {
+        return book ? book->entries() : 0;
+    }
+    
+    void set_own_book(bool value) {
+        own_book = value;
+    }
+    
+    void set_hash(int size_mb, TTAllocation mode = TT_ALLOC_AUTO) {
+        tt.resize(std::clamp(size_mb, 1, MAX_HASH_MB), mode);
+    }
+    
+    void new_game() {
+        set_position(constants::STARTPOS);
+        tt.clear();
+        for (auto& worker : workers) {
+            worker->clear_history();
+        }
+    }
+    
+    // `position` arrives in full before every move. When it names the same
+    // base position and extends the move list already played on it, only the
+    // new moves are made; anything else sets the position up from scratch.
+    void set_position(std::string_view fen, std::string_view moves = {}) {
+        bool extends = fen == position_fen && moves.substr(0, position_moves.size()) == position_moves &&
+                       (moves.size() == position_moves.size() || position_moves.empty() ||
+                        moves[position_moves.size()] == ' ');
+        if (extends) {
+            moves.remove_prefix(position_moves.size());
+        } else {
+            position_fen.assign(fen);
+            position_moves.clear();
+            bool ok = false;
+            try {
+                ok = board.setFen(fen);
+            } catch (const std::exception& e) {
+                std::cerr << "Error setting position: " << e.what() << std::endl;
+            }
+            if (!ok) {
+                board.setFen(constants::STARTPOS);
+                position_fen = constants::STARTPOS;
+            }
+        }
+        
+        for (std::string_view move = uci_token(moves); !move.empty(); move = uci_token(moves)) {
+            if (!make_move(move)) break;
+            if (!position_moves.empty()) position_moves += ' ';
+            position_moves.append(move);
+        }
+    }
+    
+    // A move from the GUI only has to pass the same pseudo-legal and king
+    // safety test as TT moves, not a scan of the generated move list.
+    bool make_move(std::string_view move_str) {
+        try {
+            Move move = uci::uciToMove(board, std::string(move_str));
+            if (move == Move::NO_MOVE) {
+                std::cerr << "Invalid move format: " << move_str << std::endl;
+                return false;
+            }
+            if (!is_legal_move(board, move)) {
+                std::cerr << "Illegal move attempted: " << move_str << std::endl;
+                return false;
+            }
+            board.makeMove(move);
+            return true;
+        } catch (const std::exception& e) {
+            std::cerr << "Error making move: " << e.what() << std::endl;
+            return false;
+        }
+    }
+    
+    bool is_move_legal(const Move& move) const {
+        return is_legal_move(board, move);
+    }
+    
+    Move get_first_legal_move() const {
+        Movelist legal_moves;
+        movegen::legalmoves(legal_moves, board);
+        
+        if (!legal_moves.empty()) {
+            return legal_moves[0];
+        }
+        return Move::NO_MOVE;
+    }
+    
+    SearchStats search_stats() const {
+        SearchStats total;
+        for (const auto& worker : workers) {
+            total += worker->search_stats();
+        }
+        return total;
+    }
+    
+    std::uint64_t total_nodes() const {
+        std::uint64_t nodes = 0;
+        for (const auto& worker : workers) {
+            nodes += worker->nodes();
+        }
+        return nodes;
+    }
+    
+    std::uint64_t total_tbhits() const {
+        std::uint64_t hits = 0;
+        for (const auto& worker : workers) {
+            hits += worker->tablebase_hits();
+        }
+        return hits;
+    }
+    
+    Move search(int max_depth = 10) {
+        prepare_search(false);
+        return run_search(max_depth);
+    }
+    
+    // Runs the search on its own thread so `stop`, `ponderhit` and `isready`
+    // are handled while it thinks. on_done receives the best move and the
+    // expected reply once the search ends; with `infinite` set that is only
+    // after `stop` or `ponderhit`.
+    void search_async(int max_depth, bool infinite, std::function<void(Move, Move)> on_done) {
+        wait();
+        prepare_search(infinite);
+        search_thread = std::thread([this, max_depth, on_done] {
+            Move best_move = run_search(max_depth);
+            on_done(best_move, ponder_move);
+        });
+    }
+    
+    // The opponent played the predicted move: the clock starts now.
+    void ponderhit() {
+        limits.search_start = std::chrono::steady_clock::now();
+        limits.infinite = false;
+    }
+    
+    void wait() {
+        if (search_thread.joinable()) {
+            search_thread.join();
+        }
+    }
+    
+private:
+    // Called on the UCI thread before the search thread exists, so a `stop`
+    // that follows `go` immediately cannot be lost.
+    void prepare_search(bool infinite) {
+        stop_search = false;
+        limits.infinite = infinite;
+        limits.search_start = std::chrono::steady_clock::now();
+    }
+    
+    // In infinite and ponder mode the GUI expects no bestmove until it sends
+    // `stop` or `ponderhit`, even if the depth limit ran out.
+    void wait_for_release() {
+        while (limits.infinite && !stop_search) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    
+    // Lazy SMP: helpers search the same root on their own boards and only
+    // cooperate through the shared table. The reported move is always the
+    // main worker's.
+    Move run_search(int max_depth) {
+        tt.new_search();
+        depth_nodes.clear();
+        ponder_move = Move::NO_MOVE;
+        search_score = 0;
+        
+        // Book moves are played without searching at all.
+        Move book_move = own_book && book ? book->probe(board) : Move::NO_MOVE;
+        if (book_move != Move::NO_MOVE) {
+            if (!silent) {
+                uci_send("info string book move " + uci::moveToUci(book_move));
+            }
+            wait_for_release();
+            return book_move;
+        }
+        
+        // A root position in the tablebases needs no search: the DTZ move
+        // keeps the result and makes progress under the 50-move rule.
+        Move tb_move = Move::NO_MOVE;
+        int tb_score = 0;
+        if (Tablebases::probe_root(board, tb_move, tb_score)) {
+            if (!silent) {
+                uci_send("info depth 1 score " + format_score(tb_score) + " nodes 0 time 0 tbhits 1 pv " +
+                         uci::moveToUci(tb_move));
+            }
+            wait_for_release();
+            search_score = tb_score;
+            return tb_move;
+        }
+        
+        for (auto& worker : workers) {
+            worker->reset(board);
+        }
+        
+        std::vector<std::thread> helpers;
+        for (size_t i = 1; i < workers.size(); ++i) {
+            helpers.emplace_back([this, i, max_depth] { workers[i]->iterative_deepening(max_depth); });
+        }
+        
+        SearchWorker& main_worker = *workers[0];
+        Move best_move = Move::NO_MOVE;
+        std::vector<Move> pv;
+        int score = 0;
+        
+        for (int depth = 1; depth <= max_depth && !stop_search; ++depth) {
+            score = main_worker.aspiration_search(depth, score);
+            
+            if (!stop_search) {
+                best_move = main_worker.best_move();
+                pv = main_worker.principal_variation();
+                search_score = score;
+                depth_nodes.push_back(total_nodes());
+                
+                auto elapsed = std::chrono::steady_clock::now() - limits.search_start.load();
+                auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count();
+                bool out_of_time = time_manager.iteration_done(best_move, score, ms) && !limits.infinite;
+                
+                if (!silent) {
+                    std::ostringstream info;
+                    info << "info depth " << depth 
+                         << " score " << format_score(score)
+                         << " nodes " << total_nodes()
+                         << " time " << ms
+                         << " hashfull " << tt.hashfull();
+                    if (Tablebases::largest() > 0) {
+                        info << " tbhits " << total_tbhits();
+                    }
+                    info << " pv";
+                    for (Move move : pv) {
+                        info << " " << uci::moveToUci(move);
+                    }
+                    uci_send(info.str());
+                }
+                
+                if (out_of_time) break;
+            }
+        }
+        
+        wait_for_release();
+        
+        // A move that beat the previous best in an unfinished iteration was
+        // searched completely, so it is still the better choice.
+        if (main_worker.best_move() != Move::NO_MOVE) {
+            best_move = main_worker.best_move();
+        }
+        
+        stop_search = true;
+        for (auto& helper : helpers) {
+            helper.join();
+        }
+        
+        if (best_move == Move::NO_MOVE || !is_move_legal(best_move)) {
+            best_move = get_first_legal_move();
+        }
+        
+        // An interrupted iteration leaves the root line empty unless it found a
+        // new best move, so fall back to the last completed one.
+        std::vector<Move> last_pv = main_worker.principal_variation();
+        if (!last_pv.empty() && last_pv[0] == best_move) pv = last_pv;
+        ponder_move = pv.size() >= 2 && pv[0] == best_move ? pv[1] : Move::NO_MOVE;
+        
+#ifdef SEARCH_STATS
+        if (!silent) {
+            uci_send(stats_info_line());
+        }
+#endif
+        
+        return best_move;
+    }
+    
+public:
+    // `info string` summary of the counters of the last search.
+    std::string stats_info_line() const {
+        SearchStats stats = search_stats();
+        std::ostringstream line;
+        line << std::fixed;
+        line.precision(1);
+        line << "info string tt hit " << percent(stats.tt_hits, stats.tt_probes) << "%"
+             << " cut exact " << percent(stats.tt_cutoffs[TT_EXACT], stats.tt_hits) << "%"
+             << " alpha " << percent(stats.tt_cutoffs[TT_ALPHA], stats.tt_hits) << "%"
+             << " beta " << percent(stats.tt_cutoffs[TT_BETA], stats.tt_hits) << "%"
+             << " firstcut " << percent(stats.first_move_cutoffs, stats.beta_cutoffs) << "%"
+             << " nullcut " << percent(stats.null_cutoffs, stats.null_tries) << "%"
+             << " qnodes " << percent(stats.qsearch_nodes, stats.qsearch_nodes + stats.main_nodes) << "%"
+             << " bf";
+        line.precision(2);
+        for (double factor : branching_factors(depth_nodes)) {
+            line << " " << factor;
+        }
+        return line.str();
+    }
+    
+    // Fixed time per move, no overhead subtracted.
+    void set_time_limit(int ms) {
+        TimeControl control;
+        control.move_time = ms;
+        time_manager.init(control, 0);
+        limits.hard_limit = std::chrono::milliseconds(time_manager.hard());
+    }
+    
+    // wtime/btime and winc/binc are picked by the side to move.
+    void set_time_control(int wtime, int btime, int winc, int binc, int moves_to_go, int move_time) {
+        bool white = board.sideToMove() == Color::WHITE;
+        TimeControl control;
+        control.time = white ? wtime : btime;
+        control.increment = white ? winc : binc;
+        control.moves_to_go = moves_to_go;
+        control.move_time = move_time;
+        time_manager.init(control, move_overhead);
+        limits.hard_limit = std::chrono::milliseconds(time_manager.hard());
+    }
+    
+    // `go nodes`: the main worker stops after this many nodes (0 = no limit).
+    void set_node_limit(std::uint64_t nodes) {
+        limits.node_limit = nodes;
+    }
+    
+    // Score of the last search, from the side to move's point of view.
+    int last_score() const {
+        return search_score;
+    }
+    
+    void set_move_overhead(int ms) {
+        move_overhead = std::clamp(ms, 0, 5000);
+    }
+    
+    void stop() {
+        stop_search = true;
+    }
+    
+    std::string get_fen() const {
+        return board.getFen();
+    }
+};
+
+class UCIInterface {
+private:
+    ChessEngine engine;
+    
+    // Commands that change the position or the engine must not run under a
+    // live search; a GUI that forgot `stop` gets its bestmove first.
+    void finish_search() {
+        engine.stop();
+        engine.wait();
+    }
+    
+    static void send_best_move(Move best_move, Move ponder_move) {
+        if (best_move == Move::NO_MOVE) {
+            std::cerr << "No legal moves available!" << std::endl;
+            uci_send("bestmove 0000");
+            return;
+        }
+        
+        std::string line = "bestmove " + uci::moveToUci(best_move);
+        if (ponder_move != Move::NO_MOVE) {
+            line += " ponder " + uci::moveToUci(ponder_move);
+        }
+        uci_send(line);
+    }
+    
+public:
+    void run() {
+        std::string line;
+        
+        while (std::getline(std::cin, line)) {
+            try {
+                std::string_view rest = line;
+                std::string_view command = uci_token(rest);
+                
+                if (command == "uci") {
+                    std::cout << "id name ChessEngine" << std::endl;
+                    std::cout << "id author Assistant" << std::endl;
+                    std::cout << "option name Hash type spin default 16 min 1 max " << MAX_HASH_MB << std::endl;
+                    std::cout << "option name Threads type spin default 1 min 1 max " << MAX_THREADS << std::endl;
+                    std::cout << "option name Ponder type check default false" << std::endl;
+                    std::cout << "option name MoveOverhead type spin default " << DEFAULT_MOVE_OVERHEAD << " min 0 max 5000" << std::endl;
+                    std::cout << "option name EvalFile type string default <empty>" << std::endl;
+                    std::cout << "option name EvalParams type string default <empty>" << std::endl;
+                    std::cout << "option name OwnBook type check default false" << std::endl;
+                    std::cout << "option name BookFile type string default <empty>" << std::endl;
+#ifdef USE_SYZYGY
+                    std::cout << "option name SyzygyPath type string default <empty>" << std::endl;
+                    std::cout << "option name SyzygyProbeLimit type spin default 7 min 0 max 7" << std::endl;
+#endif
+                    std::cout << "uciok" << std::endl;
+                }
+                else if (command == "isready") {
+                    uci_send("readyok");
+                }
+                else if (command == "setoption") {
+                    finish_search();
+                    // setoption name <id> [value <x>]: both may contain spaces.
+                    uci_token(rest);
+                    std::string_view options = rest;
+                    size_t value_at = options.find(" value ");
+                    if (value_at == std::string_view::npos && options.size() >= 6 &&
+                        options.substr(options.size() - 6) == " value") {
+                        value_at = options.size() - 6;
+                    }
+                    std::string name(uci_trim(options.substr(0, value_at)));
+                    std::string value(value_at == std::string_view::npos ? std::string_view()
+                                                                         : uci_trim(options.substr(value_at + 6)));
+                    
+                    if (name == "Hash") {
+                        engine.set_hash(std::stoi(value));
+                    }
+                    else if (name == "Threads") {
+                        engine.set_threads(std::stoi(value));
+                    }
+                    else if (name == "MoveOverhead") {
+                        engine.set_move_overhead(std::stoi(value));
+                    }
+                    else if (name == "EvalFile") {
+                        std::string error;
+                        if (engine.load_network(value, error)) {
+                            uci_send("info string evaluation: " + (value.empty() || value == "<empty>" ? std::string("PST") : "NNUE " + value));
+                        } else {
+                            uci_send("info string EvalFile not loaded (" + error + "), keeping current evaluation");
+                        }
+                    }
+                    else if (name == "EvalParams") {
+                        std::string error;
+                        if (value.empty() || value == "<empty>") {
+                            eval_params = EvalParams();
+                        } else if (eval_params.load(value, error)) {
+                            uci_send("info string evaluation parameters from " + value);
+                        } else {
+                            uci_send("info string EvalParams not loaded (" + error + ")");
+                        }
+                    }
+                    else if (name == "OwnBook") {
+                        engine.set_own_book(value == "true");
+                    }
+                    else if (name == "BookFile") {
+                        std::string error;
+                        if (engine.load_book(value, error)) {
+                            uci_send("info string book: " + std::to_string(engine.book_entries()) + " entries");
+                        } else {
+                            uci_send("info string BookFile not loaded (" + error + "), keeping current book");
+                        }
+                    }
+                    else if (name == "SyzygyPath") {
+                        if (Tablebases::init(value)) {
+                            uci_send("info string found " + std::to_string(Tablebases::largest()) + "-piece tablebases");
+                        } else {
+#ifdef USE_SYZYGY
+                            uci_send("info string SyzygyPath not loaded: " + value);
+#else
+                            uci_send("info string Syzygy support not compiled in (build with build_syzygy.sh)");
+#endif
+                        }
+                    }
+                    else if (name == "SyzygyProbeLimit") {
+                        Tablebases::set_probe_limit(std::clamp(std::stoi(value), 0, 7));
+                    }
+                }
+                else if (command == "ucinewgame") {
+                    finish_search();
+                    engine.new_game();
+                }
+                else if (command == "position") {
+                    finish_search();
+                    std::string_view type = uci_token(rest);
+                    size_t moves_at = rest.find(" moves");
+                    std::string_view fen = type == "startpos" ? std::string_view(constants::STARTPOS)
+                                                              : uci_trim(rest.substr(0, moves_at));
+                    std::string_view moves = moves_at == std::string_view::npos ? std::string_view()
+                                                                                : uci_trim(rest.substr(moves_at + 6));
+                    if (type == "startpos" || type == "fen") {
+                        engine.set_position(fen, moves);
+                    }
+                }
+                else if (command == "go") {
+                    finish_search();
+                    int depth = -1;
+                    int wtime = -1, btime = -1, winc = 0, binc = 0;
+                    int movestogo = 0, movetime = -1, nodes = 0;
+                    bool infinite = false;
+                    bool ponder = false;
+                    
+                    for (std::string_view param = uci_token(rest); !param.empty(); param = uci_token(rest)) {
+                        if (param == "infinite") infinite = true;
+                        else if (param == "ponder") ponder = true;
+                        else if (param == "depth") depth = uci_int(rest, depth);
+                        else if (param == "movetime") movetime = uci_int(rest, movetime);
+                        else if (param == "wtime") wtime = uci_int(rest, wtime);
+                        else if (param == "btime") btime = uci_int(rest, btime);
+                        else if (param == "winc") winc = uci_int(rest, winc);
+                        else if (param == "binc") binc = uci_int(rest, binc);
+                        else if (param == "movestogo") movestogo = uci_int(rest, movestogo);
+                        else if (param == "nodes") nodes = uci_int(rest, nodes);
+                    }
+                    
+                    bool timed = wtime >= 0 || btime >= 0 || movetime >= 0 || nodes > 0;
+                    if (!timed && depth < 0 && !infinite) {
+                        // Bare `go`: the old fixed budget.
+                        depth = 10;
+                        movetime = 5000;
+                    }
+                    if (depth < 0) depth = MAX_PLY - 1;
+                    engine.set_time_control(wtime, btime, winc, binc, movestogo, movetime);
+                    engine.set_node_limit(std::max(nodes, 0));
+                    
+                    // While pondering the clock belongs to the opponent: search
+                    // without a time limit until `ponderhit` hands it back.
+                    engine.search_async(depth, infinite || ponder, send_best_move);
+                }
+                else if (command == "ponderhit") {
+                    engine.ponderhit();
+                }
+                else if (command == "stop") {
+                    finish_search();
+                }
+                else if (command == "quit") {
+                    break;
+                }
+            } catch (const std::exception& e) {
+                std::cerr << "UCI Error: " << e.what() << std::endl;
+            }
+        }
+        
+        finish_search();
+    }
+};
+
+// ./chess_engine ttbench [hash_mb] [depth]
+// Compares the table allocation modes: random probe latency over the whole
+// table, then a fixed-depth search from the start position.
+void run_tt_bench(int size_mb, int depth) {
+    const TTAllocation modes[] = {TT_ALLOC_DEFAULT, TT_ALLOC_THP, TT_ALLOC_HUGETLB};
+    const int probes = 4000000;
+    
+    for (TTAllocation mode : modes) {
+        TranspositionTable tt;
+        tt.resize(size_mb, mode);
+        if (tt.allocation() != mode) {
+            std::cout << allocation_name(mode) << ": unavailable, fell back to "
+                      << allocation_name(tt.allocation()) << std::endl;
+            continue;
+        }
+        
+        std::mt19937_64 rng(2024);
+        for (int i = 0; i < probes; ++i) {
+            tt.store(rng(), Move::NO_MOVE, 1 + i % 16, 0, TT_EXACT);
+        }
+        
+        rng.seed(2024);
+        TTEntry entry;
+        int hits = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < probes; ++i) {
+            hits += tt.probe(rng(), entry);
+        }
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        double ns = std::chrono::duration<double, std::nano>(elapsed).count() / probes;
+        
+        ChessEngine engine;
+        engine.set_hash(size_mb, mode);
+        engine.set_silent(true);
+        engine.set_time_limit(INT_MAX);
+        start = std::chrono::steady_clock::now();
+        engine.search(depth);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        
+        std::cout << allocation_name(mode) << ": " << ns << " ns/probe, "
+                  << hits << " hits, search " << engine.total_nodes() << " nodes, "
+                  << static_cast<std::uint64_t>(engine.total_nodes() / std::max(seconds, 1e-9)) << " nps" << std::endl;
+    }
+}
+
+const char* BENCH_FENS[] = {
+    // Openings and middlegames
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+    "r1bqkb1r/pppp1ppp/2n2n2/4p3/2B1P3/5N2/PPPP1PPP/RNBQK2R w KQkq - 4 4",
+    "r2q1rk1/pp2bppp/2n1pn2/3p4/2PP4/2N1PN2/PP2BPPP/R2Q1RK1 w - - 0 9",
+    "r1bq1rk1/ppp2ppp/2np1n2/2b1p3/2B1P3/2PP1N2/PP3PPP/RNBQ1RK1 w - - 0 7",
+    "4rrk1/pp3ppp/2p5/8/3Pn3/2PB4/P4PPP/R4RK1 w - - 0 18",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+    "6k1/5ppp/8/8/8/8/5PPP/3R2K1 w - - 0 1",
+    "4rrk1/pp1n3p/3q2pQ/2p1pb2/2PP4/2P3N1/P2B2PP/4RRK1 b - - 7 19",
+    "rq3rk1/ppp2ppp/1bnpb3/3N2B1/3NP3/7P/PPPQ1PP1/2KR3R w - - 7 14",
+    "r1bq1r1k/1pp1n1pp/1p1p4/4p2Q/4Pp2/1BNP4/PPP2PPP/3R1RK1 w - - 2 14",
+    "r3r1k1/2p2ppp/p1p1bn2/8/1q2P3/2NPQN2/PPP3PP/R4RK1 b - - 2 15",
+    "r1bbk1nr/pp3p1p/2n5/1N4p1/2Np1B2/8/PPP2PPP/2KR1B1R w kq - 0 13",
+    "r1bq1rk1/ppp1nppp/4n3/3p3Q/3P4/1BP1B3/PP1N2PP/R4RK1 w - - 1 16",
+    "4r1k1/r1q2ppp/ppp2n2/4P3/5Rb1/1N1BQ3/PPP3PP/R5K1 w - - 1 17",
+    "2rqkb1r/ppp2p2/2npb1p1/1N1Nn2p/2P1PP2/8/PP2B1PP/R1BQK2R b KQ - 0 11",
+    "r1bq1r1k/b1p1npp1/p2p3p/1p6/3PP3/1B2NN2/PP3PPP/R2Q1RK1 w - - 1 16",
+    "3r1rk1/p5pp/bpp1pp2/8/q1PP1P2/b3P3/P2NQRPP/1R2B1K1 b - - 6 22",
+    "r1q2rk1/2p1bppp/2Pp4/p6b/Q1PNp3/4B3/PP1R1PPP/2K4R w - - 2 18",
+    "4k2r/1pb2ppp/1p2p3/1R1p4/3P4/2r1PN2/P4PPP/1R4K1 b - - 3 22",
+    "3q2k1/pb3p1p/4pbp1/2r5/PpN2N2/1P2P2P/5PP1/Q2R2K1 b - - 4 26",
+    "r3k2r/3nnpbp/q2pp1p1/p7/Pp1PPPP1/4BNN1/1P5P/R2Q1RK1 w kq - 0 16",
+    "3Qb1k1/1r2ppb1/pN1n2q1/Pp1Pp1Pr/4P2p/4BP2/4B1R1/1R5K b - - 11 40",
+    "4k3/3q1r2/1N2r1b1/3ppN2/2nPP3/1B1R2n1/2R1Q3/3K4 w - - 5 1",
+    "6k1/3b3r/1p1p4/p1n2p2/1PPNpP1q/P3Q1p1/1R1RB1P1/5K2 b - - 0 1",
+    "r2r1n2/pp2bk2/2p1p2p/3q4/3PN1QP/2P3R1/P4PP1/5RK1 w - - 0 1",
+    "5rk1/q6p/2p3bR/1pPp1rP1/1P1Pp3/P3B1Q1/1K3P2/R7 w - - 93 90",
+    "4rrk1/1p1nq3/p7/2p1P1pp/3P2bp/3Q1Bn1/PPPB4/1K2R1NR w - - 40 21",
+    // Endgames
+    "6k1/6p1/6Pp/ppp5/3pn2P/1P3K2/1PP2P2/3N4 b - - 0 1",
+    "3b4/5kp1/1p1p1p1p/pP1PpP1P/P1P1P3/3KN3/8/8 w - - 0 1",
+    "2K5/p7/7P/5pR1/8/5k2/r7/8 w - - 0 1",
+    "8/6pk/1p6/8/PP3p1p/5P2/4KP1q/3Q4 w - - 0 1",
+    "7k/3p2pp/4q3/8/4Q3/5Kp1/P6b/8 w - - 0 1",
+    "8/2p5/8/2kPKp1p/2p4P/2P5/3P4/8 w - - 0 1",
+    "8/1p3pp1/7p/5P1P/2k3P1/8/2K2P2/8 w - - 0 1",
+    "8/pp2r1k1/2p1p3/3pP2p/1P1P1P1P/P5KR/8/8 w - - 0 1",
+    "8/3p4/p1bk3p/Pp6/1Kp1PpPp/2P2P1P/2P5/5B2 b - - 0 1",
+    "5k2/7R/4P2p/5K2/p1r2P1p/8/8/8 b - - 0 1",
+    "6k1/6p1/P6p/r1N5/5p2/7P/1b3PP1/4R1K1 w - - 0 1",
+    "1r3k2/4q3/2Pp3b/3Bp3/2Q2p2/1p1P2P1/1P2KP2/3N4 w - - 0 1",
+    "6k1/4pp1p/3p2p1/P1pPb3/R7/1r2P1PP/3B1P2/6K1 w - - 0 1",
+    "8/3p3B/5p2/5P2/p7/PP5b/k7/6K1 w - - 0 1",
+    "8/8/8/8/5kp1/P7/8/1K1N4 w - - 0 1",
+    "8/8/8/5N2/8/p7/8/2NK3k w - - 0 1",
+    "8/3k4/8/8/8/4B3/4KB2/2B5 w - - 0 1",
+    "8/8/1P6/5pr1/8/4R3/7k/2K5 w - - 0 1",
+    "8/2p4P/8/kr6/6R1/8/8/1K6 w - - 0 1",
+    "8/8/3P3k/8/1p6/8/1P6/1K3n2 b - - 0 1",
+    "8/R7/2q5/8/6k1/8/1P5p/K6R w - - 0 124",
+    // Forced mates from Week3's m8n2/m8n3/m8n4 puzzle files
+    "4kb1r/p2n1ppp/4q3/4p1B1/4P3/1Q6/PPP2PPP/2KR4 w k - 1 0",
+    "r6k/pp4pp/1b1P4/8/1n4Q1/2N1RP2/PPq3p1/1RB1K3 b - - 0 1",
+    "r1b1k1nr/p2p1ppp/n2B4/1p1NPN1P/6P1/3P1Q2/P1P1K3/q5b1 w - - 1 0",
+    "3r1rk1/p1p4p/8/1PP1p1bq/2P5/3N1Pp1/PB2Q3/1R3RK1 b - - 0 1",
+    "r1b3kr/3pR1p1/ppq4p/5P2/4Q3/B7/P5PP/5RK1 w - - 1 0",
+    "6rk/7p/pp3b2/2pbqP2/5Q2/5R1P/P6P/2B2R1K b - - 0 1",
+};
+
+// Counters summed over the bench, as one JSON object.
+void print_stats_json(const SearchStats& stats, const std::vector<std::uint64_t>& depth_totals) {
+    std::cout << "{\n"
+              << "  \"tt_probes\": " << stats.tt_probes << ",\n"
+              << "  \"tt_hit_pct\": " << percent(stats.tt_hits, stats.tt_probes) << ",\n"
+              << "  \"tt_cutoff_pct\": {\"exact\": " << percent(stats.tt_cutoffs[TT_EXACT], stats.tt_hits)
+              << ", \"alpha\": " << percent(stats.tt_cutoffs[TT_ALPHA], stats.tt_hits)
+              << ", \"beta\": " << percent(stats.tt_cutoffs[TT_BETA], stats.tt_hits) << "},\n"
+              << "  \"beta_cutoffs\": " << stats.beta_cutoffs << ",\n"
+              << "  \"first_move_cutoff_pct\": " << percent(stats.first_move_cutoffs, stats.beta_cutoffs) << ",\n"
+              << "  \"null_move_tries\": " << stats.null_tries << ",\n"
+              << "  \"null_move_cutoff_pct\": " << percent(stats.null_cutoffs, stats.null_tries) << ",\n"
+              << "  \"main_nodes\": " << stats.main_nodes << ",\n"
+              << "  \"qsearch_nodes\": " << stats.qsearch_nodes << ",\n"
+              << "  \"qsearch_pct\": " << percent(stats.qsearch_nodes, stats.qsearch_nodes + stats.main_nodes) << ",\n"
+              << "  \"branching_factor\": [";
+    std::vector<double> factors = branching_factors(depth_totals);
+    for (size_t i = 0; i < factors.size(); ++i) {
+        std::cout << (i ? ", " : "") << factors[i];
+    }
+    std::cout << "]\n}" << std::endl;
+}
+
+// ./chess_engine bench [depth] [threads] [hash_mb]
+// Fixed-depth search over BENCH_FENS from an empty table. Reports total nodes,
+// speed, and the effective branching factor: the geometric mean over the
+// positions of sqrt(nodes of the last iteration / nodes two iterations before).
+// With one thread the node total is deterministic and serves as a signature
+// of the search: any change to it means the tree changed.
+void run_bench(int depth, int threads, int hash_mb) {
+    ChessEngine engine;
+    engine.set_silent(true);
+    engine.set_threads(threads);
+    engine.set_hash(hash_mb);
+    engine.set_time_limit(INT_MAX);
+    
+    std::uint64_t total = 0;
+    double log_ebf = 0.0;
+    int ebf_samples = 0;
+    SearchStats stats;
+    std::vector<std::uint64_t> depth_totals(depth, 0);
+    auto start = std::chrono::steady_clock::now();
+    
+    int index = 0;
+    for (const char* fen : BENCH_FENS) {
+        engine.new_game();
+        engine.set_position(fen);
+        engine.search(depth);
+        
+        const auto& nodes = engine.iteration_nodes();
+        total += nodes.back();
+        stats += engine.search_stats();
+        for (size_t d = 0; d < nodes.size() && d < depth_totals.size(); ++d) {
+            depth_totals[d] += nodes[d];
+        }
+        
+        size_t n = nodes.size();
+        if (n >= 4) {
+            double last = static_cast<double>(nodes[n - 1] - nodes[n - 2]);
+            double earlier = static_cast<double>(nodes[n - 3] - nodes[n - 4]);
+            if (last > 0 && earlier > 0) {
+                log_ebf += 0.5 * std::log(last / earlier);
+                ebf_samples++;
+            }
+        }
+        
+        std::cout << "Position " << ++index << ": " << nodes.back() << " nodes" << std::endl;
+    }
+    
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "===========================" << std::endl;
+    std::cout << "Depth       : " << depth << " (" << threads << " threads, " << hash_mb << " MB)" << std::endl;
+    std::cout << "Total nodes : " << total << std::endl;
+    std::cout << "Time (ms)   : " << static_cast<std::uint64_t>(seconds * 1000) << std::endl;
+    std::cout << "Nodes/second: " << static_cast<std::uint64_t>(total / std::max(seconds, 1e-9)) << std::endl;
+    std::cout << "EBF         : " << (ebf_samples ? std::exp(log_ebf / ebf_samples) : 0.0) << std::endl;
+    if (threads == 1) {
+        std::cout << "Signature   : " << total << std::endl;
+    }
+    
+#ifdef SEARCH_STATS
+    print_stats_json(stats, depth_totals);
+#else
+    (void)stats;
+#endif
+}
+
+// ./chess_engine nnuecheck <net.nnue> [depth]
+// Checks the incremental NNUE accumulator against a full rebuild: from every
+// BENCH_FENS position, each legal line to `depth` plies (default 3) is played
+// through the search's make_move, and the accumulator is compared with a
+// refresh at every node.
+int run_nnue_check(int argc, char* argv[]) {
+    if (argc < 3) {
+        std::cerr << "usage: chess_engine nnuecheck <net.nnue> [depth]" << std::endl;
+        return 1;
+    }
+    int depth = argc > 3 ? std::stoi(argv[3]) : 3;
+    
+    NNUENetwork network;
+    std::string error;
+    if (!network.load(argv[2], error)) {
+        std::cerr << error << std::endl;
+        return 1;
+    }
+    
+    TranspositionTable tt(1);
+    std::atomic<bool> stop(false);
+    SearchLimits limits;
+    auto worker = std::make_unique<SearchWorker>(tt, stop, limits, 0);
+    worker->set_network(&network);
+    
+    std::uint64_t checked = 0, mismatches = 0;
+    int index = 0;
+    for (const char* fen : BENCH_FENS) {
+        worker->reset(Board(fen));
+        std::uint64_t bad = worker->verify_accumulators(depth, checked);
+        mismatches += bad;
+        if (bad) std::cout << "Position " << index + 1 << ": " << bad << " mismatches" << std::endl;
+        ++index;
+    }
+    
+    std::cout << "===========================" << std::endl;
+    std::cout << "Nodes checked: " << checked << std::endl;
+    std::cout << "Mismatches   : " << mismatches << std::endl;
+    return mismatches == 0 ? 0 : 1;
+}
+
+// ./chess_engine tbprobe <SyzygyPath> [fen]
+// Probes one position (default KQvK, white to move) the way the search does:
+// WDL for the side to move, then the DTZ move the root would play. Needs a
+// build with -DUSE_SYZYGY (build_syzygy.sh).
+int run_tb_probe(int argc, char* argv[]) {
+    if (argc < 3) {
+        std::cerr << "usage: chess_engine tbprobe <SyzygyPath> [fen]" << std::endl;
+        return 1;
+    }
+    std::string fen = "8/8/8/4k3/8/8/8/KQ6 w - - 0 1";
+    if (argc > 3) {
+        fen.clear();
+        for (int i = 3; i < argc; ++i) fen += std::string(i > 3 ? " " : "") + argv[i];
+    }
+    
+    if (!Tablebases::init(argv[2]) || Tablebases::largest() == 0) {
+#ifdef USE_SYZYGY
+        std::cerr << "no tablebases found under " << argv[2] << std::endl;
+#else
+        std::cerr << "Syzygy support not compiled in (build with build_syzygy.sh)" << std::endl;
+#endif
+        return 1;
+    }
+    
+    Board board(fen);
+    std::cout << "Tablebases: " << Tablebases::largest() << "-piece" << std::endl;
+    std::cout << "Position  : " << board.getFen() << std::endl;
+    
+    int score = 0;
+    if (Tablebases::probe_wdl(board, 0, score)) {
+        std::cout << "WDL       : " << (score > 0 ? "win" : score < 0 ? "loss" : "draw") << std::endl;
+    } else {
+        std::cout << "WDL       : not probed" << std::endl;
+    }
+    Move move = Move::NO_MOVE;
+    if (Tablebases::probe_root(board, move, score)) {
+        std::cout << "Root move : " << uci::moveToUci(move) << " score " << format_score(score) << std::endl;
+    } else {
+        std::cout << "Root move : not probed" << std::endl;
+    }
+    Tablebases::init("");
+    return 0;
+}
+
+// Perft counts the leaves of the legal move tree, the standard check of a
+// move generator. Leaves are bulk-counted: at depth 1 the size of the move
+// list is the answer, without making the moves.
+class Perft {
+private:
+    struct Entry {
+        std::uint64_t key;
+        std::uint64_t count;
+    };
+    
+    Board board;
+    std::vector<Entry> table;
+    
+    // Subtree counts are cached under the position hash with the depth mixed
+    // in, so transpositions are counted once
+    std::uint64_t count(int depth) {
+        Movelist moves;
+        movegen::legalmoves(moves, board);
+        if (depth == 1) return moves.size();
+        
+        std::uint64_t key = board.hash() ^ (std::uint64_t(depth) * 0x9E3779B97F4A7C15ULL);
+        Entry* entry = table.empty() ? nullptr : &table[key & (table.size() - 1)];
+        if (entry && entry->key == key) return entry->count;
+        
+        std::uint64_t nodes = 0;
+        for (const Move move : moves) {
+            board.makeMove(move);
+            nodes += count(depth - 1);
+            board.unmakeMove(move);
+        }
+        
+        if (entry) *entry = Entry{key, nodes};
+        return nodes;
+    }
+    
+public:
+    // hash_mb = 0 runs without a table
+    Perft(const std::string& fen, int hash_mb) : board(fen) {
+        if (hash_mb > 0) {
+            size_t entries = 1;
+            while (entries * 2 * sizeof(Entry) <= size_t(hash_mb) << 20) entries *= 2;
+            table.assign(entries, Entry{0, 0});
+        }
+    }
+    
+    std::uint64_t run(int depth, bool divide) {
+        if (depth <= 0) return 1;
+        if (!divide) return count(depth);
+        
+        Movelist moves;
+        movegen::legalmoves(moves, board);
+        std::uint64_t total = 0;
+        for (const Move move : moves) {
+            board.makeMove(move);
+            std::uint64_t nodes = depth > 1 ? count(depth - 1) : 1;
+            board.unmakeMove(move);
+            std::cout << uci::moveToUci(move) << ": " << nodes << std::endl;
+            total += nodes;
+        }
+        return total;
+    }
+};
+
+// ./chess_engine perft <depth> [divide] [hash <mb>] [fen]
+void run_perft(int argc, char* argv[]) {
+    int depth = argc > 2 ? std::stoi(argv[2]) : 5;
+    bool divide = false;
+    int hash_mb = 0;
+    std::string fen;
+    
+    for (int i = 3; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "divide") divide = true;
+        else if (arg == "hash" && i + 1 < argc) hash_mb = std::stoi(argv[++i]);
+        else fen += (fen.empty() ? "" : " ") + arg;
+    }
+    if (fen.empty()) fen = constants::STARTPOS;
+    
+    Perft perft(fen, hash_mb);
+    auto start = std::chrono::steady_clock::now();
+    std::uint64_t nodes = perft.run(depth, divide);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    
+    std::cout << "===========================" << std::endl;
+    std::cout << "Nodes       : " << nodes << std::endl;
+    std::cout << "Time (ms)   : " << static_cast<std::uint64_t>(seconds * 1000) << std::endl;
+    std::cout << "Nodes/second: " << static_cast<std::uint64_t>(nodes / std::max(seconds, 1e-9)) << std::endl;
+}
+
+struct BenchPosition {
+    Board board;
+    Movelist moves;
+};
+
+volatile std::uint64_t bench_sink;
+
+// Times `op` over every BENCH_FENS position until about 200ms have passed,
+// and prints the mean cost of one call.
+template <typename Op>
+void time_operation(const char* name, std::vector<BenchPosition>& positions, Op op) {
+    std::uint64_t calls = 0;
+    std::uint64_t sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    double elapsed = 0;
+    
+    while (elapsed < 0.2) {
+        for (BenchPosition& position : positions) {
+            calls += op(position, sink);
+        }
+        elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    
+    bench_sink = sink;
+    std::printf("%-24s %10.1f ns %12llu calls\n", name, elapsed * 1e9 / calls,
+                static_cast<unsigned long long>(calls));
+}
+
+// ./chess_engine movegenbench
+// Micro-benchmarks of the chess.hpp calls the search is made of. The
+// make/unmake pair runs over pre-generated legal moves, so it excludes
+// move generation.
+void run_movegen_bench() {
+    std::vector<BenchPosition> positions;
+    for (const char* fen : BENCH_FENS) {
+        BenchPosition position{Board(fen), Movelist()};
+        movegen::legalmoves(position.moves, position.board);
+        positions.push_back(position);
+    }
+    
+    std::printf("%-24s %13s %18s\n", "Benchmark", "Time", "Iterations");
+    time_operation("legalmoves<ALL>", positions, [](BenchPosition& position, std::uint64_t& sink) {
+        Movelist moves;
+        movegen::legalmoves(moves, position.board);
+        sink += moves.size();
+        return 1;
+    });
+    time_operation("legalmoves<CAPTURE>", positions, [](BenchPosition& position, std::uint64_t& sink) {
+        Movelist moves;
+        movegen::legalmoves<movegen::MoveGenType::CAPTURE>(moves, position.board);
+        sink += moves.size();
+        return 1;
+    });
+    time_operation("makeMove+unmakeMove", positions, [](BenchPosition& position, std::uint64_t& sink) {
+        for (const Move move : position.moves) {
+            position.board.makeMove(move);
+            sink += position.board.occ().getBits();
+            position.board.unmakeMove(move);
+        }
+        return position.moves.size();
+    });
+    time_operation("hash", positions, [](BenchPosition& position, std::uint64_t& sink) {
+        sink += position.board.hash();
+        return 1;
+    });
+    time_operation("isGameOver", positions, [](BenchPosition& position, std::uint64_t& sink) {
+        sink += static_cast<std::uint64_t>(position.board.isGameOver().first);
+        return 1;
+    });
+}
+
+// One training position as written by gensfen: 32 bytes, host byte order.
+// The board is chess-library's 24-byte Compact encoding (occupancy plus a
+// nibble per piece, with side to move, castling and en passant folded into
+// spare piece codes); decode it with Board::Compact::decode.
+struct TrainingRecord {
+    PackedBoard board;
+    std::int16_t score;      // search score, side to move's view
+    std::uint16_t move;      // best move, chess-library Move encoding
+    std::uint16_t ply;       // plies since the start position
+    std::int8_t result;      // game result for the side to move: 1, 0, -1
+    std::uint8_t rule50;     // half-move clock, capped at 255
+};
+
+static_assert(sizeof(TrainingRecord) == 32, "gensfen records are 32 bytes");
+
+// Batches go to a queue that one writer thread drains into the file, so a
+// game thread only ever holds the lock long enough to hand its batch over.
+class TrainingWriter {
+private:
+    std::FILE* file;
+    std::thread writer;
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::vector<std::vector<TrainingRecord>> queue;
+    bool closing;
+    
+    void drain() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            ready.wait(lock, [this] { return closing || !queue.empty(); });
+            if (queue.empty()) return;
+            
+            std::vector<std::vector<TrainingRecord>> batches;
+            batches.swap(queue);
+            lock.unlock();
+            for (const auto& batch : batches) {
+                std::fwrite(batch.data(), sizeof(TrainingRecord), batch.size(), file);
+            }
+            lock.lock();
+        }
+    }
+    
+public:
+    TrainingWriter() : file(nullptr), closing(false) {}
+    
+    ~TrainingWriter() {
+        close();
+    }
+    
+    bool open(const std::string& path) {
+        file = std::fopen(path.c_str(), "ab");
+        if (!file) return false;
+        writer = std::thread([this] { drain(); });
+        return true;
+    }
+    
+    void submit(std::vector<TrainingRecord>&& batch) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queue.push_back(std::move(batch));
+        }
+        ready.notify_one();
+    }
+    
+    void close() {
+        if (!file) return;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closing = true;
+        }
+        ready.notify_one();
+        writer.join();
+        std::fclose(file);
+        file = nullptr;
+    }
+};
+
+struct GensfenOptions {
+    std::uint64_t positions = 1000000;
+    std::uint64_t nodes = 5000;
+    int threads = 1;
+    int random_plies = 8;
+    int hash_mb = 16;
+    int max_plies = 400;
+    int adjudicate = 3000;   // a score at least this large ends the game
+    std::string output = "gensfen.bin";
+};
+
+const size_t GENSFEN_BATCH = 4096;
+
+// Plays one game from the start position: `random_plies` random moves, then
+// fixed-node searches for both sides. Positions in check or whose best move
+// is a capture or promotion are not quiet enough to train an evaluation on
+// and are skipped. Returns the game's positions with results filled in; a
+// game that ended during the random plies returns nothing.
+std::vector<TrainingRecord> play_training_game(ChessEngine& engine, std::mt19937_64& rng,
+                                               const GensfenOptions& options) {
+    std::vector<TrainingRecord> records;
+    Board board(constants::STARTPOS);
+    std::string moves;
+    engine.new_game();
+    
+    auto play = [&](Move move) {
+        if (!moves.empty()) moves += ' ';
+        moves += uci::moveToUci(move);
+        board.makeMove(move);
+    };
+    
+    for (int ply = 0; ply < options.random_plies; ++ply) {
+        Movelist legal;
+        movegen::legalmoves(legal, board);
+        if (legal.empty()) return {};
+        play(legal[static_cast<int>(rng() % legal.size())]);
+    }
+    
+    int white_result = 0;
+    for (int ply = options.random_plies; ply < options.max_plies; ++ply) {
+        auto over = board.isGameOver();
+        if (over.first != GameResultReason::NONE) {
+            if (over.first == GameResultReason::CHECKMATE) {
+                white_result = board.sideToMove() == Color::WHITE ? -1 : 1;
+            }
+            break;
+        }
+        
+        engine.set_position(constants::STARTPOS, moves);
+        Move best = engine.search(MAX_PLY - 1);
+        int score = engine.last_score();
+        if (best == Move::NO_MOVE) break;
+        
+        if (std::abs(score) >= options.adjudicate) {
+            bool white_ahead = (score > 0) == (board.sideToMove() == Color::WHITE);
+            white_result = white_ahead ? 1 : -1;
+            break;
+        }
+        
+        if (!board.inCheck() && !board.isCapture(best) && best.typeOf() != Move::PROMOTION) {
+            TrainingRecord record;
+            record.board = Board::Compact::encode(board);
+            record.score = static_cast<std::int16_t>(score);
+            record.move = best.move();
+            record.ply = static_cast<std::uint16_t>(ply);
+            record.result = board.sideToMove() == Color::WHITE ? 1 : -1;   // sign, resolved below
+            record.rule50 = static_cast<std::uint8_t>(std::min<std::uint32_t>(board.halfMoveClock(), 255));
+            records.push_back(record);
+        }
+        play(best);
+    }
+    
+    for (TrainingRecord& record : records) {
+        record.result = static_cast<std::int8_t>(record.result * white_result);
+    }
+    return records;
+}
+
+// ./chess_engine gensfen <positions> [nodes <n>] [threads <n>] [random <plies>]
+//                        [hash <mb>] [output <file>]
+// Self-play training data: each thread owns a ChessEngine and plays whole
+// games, appending exactly `positions` 32-byte records to the output file.
+void run_gensfen(int argc, char* argv[]) {
+    GensfenOptions options;
+    if (argc > 2) options.positions = std::stoull(argv[2]);
+    for (int i = 3; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if (arg == "nodes") options.nodes = std::stoull(argv[i + 1]);
+        else if (arg == "threads") options.threads = std::clamp(std::stoi(argv[i + 1]), 1, MAX_THREADS);
+        else if (arg == "random") options.random_plies = std::max(0, std::stoi(argv[i + 1]));
+        else if (arg == "hash") options.hash_mb = std::stoi(argv[i + 1]);
+        else if (arg == "output") options.output = argv[i + 1];
+    }
+    
+    TrainingWriter writer;
+    if (!writer.open(options.output)) {
+        std::cerr << "cannot open " << options.output << std::endl;
+        return;
+    }
+    
+    std::atomic<std::uint64_t> claimed(0);
+    std::atomic<std::uint64_t> games(0);
+    std::random_device seed;
+    std::uint64_t base_seed = (static_cast<std::uint64_t>(seed()) << 32) ^ seed();
+    auto start = std::chrono::steady_clock::now();
+    
+    std::vector<std::thread> pool;
+    for (int t = 0; t < options.threads; ++t) {
+        pool.emplace_back([&, t] {
+            ChessEngine engine;
+            engine.set_silent(true);
+            engine.set_hash(options.hash_mb);
+            engine.set_time_limit(INT_MAX);
+            engine.set_node_limit(options.nodes);
+            std::mt19937_64 rng(base_seed + 0x9E3779B97F4A7C15ULL * (t + 1));
+            std::vector<TrainingRecord> batch;
+            
+            while (claimed.load() < options.positions) {
+                std::vector<TrainingRecord> game = play_training_game(engine, rng, options);
+                games++;
+                
+                // Claim a slice of the remaining quota so the total is exact.
+                std::uint64_t first = claimed.fetch_add(game.size());
+                if (first >= options.positions) break;
+                size_t keep = static_cast<size_t>(std::min<std::uint64_t>(game.size(), options.positions - first));
+                batch.insert(batch.end(), game.begin(), game.begin() + keep);
+                
+                if (batch.size() >= GENSFEN_BATCH) {
+                    writer.submit(std::move(batch));
+                    batch = std::vector<TrainingRecord>();
+                }
+            }
+            if (!batch.empty()) writer.submit(std::move(batch));
+        });
+    }
+    
+    auto report = [&] {
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::uint64_t done = std::min(claimed.load(), options.positions);
+        std::cout << "positions " << done << "/" << options.positions
+                  << " games " << games.load()
+                  << " pos/s " << static_cast<std::uint64_t>(done / std::max(seconds, 1e-9)) << std::endl;
+    };
+    
+    auto last_report = start;
+    while (claimed.load() < options.positions) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        if (std::chrono::steady_clock::now() - last_report >= std::chrono::seconds(5)) {
+            last_report = std::chrono::steady_clock::now();
+            report();
         }
-        
-        Movelist moves;
-        movegen::legalmoves(moves, board);
-        
-        if (moves.empty()) {
-            if (board.inCheck()) {
-                return -MATE_VALUE + nodes_searched;
-            }
-            return DRAW_VALUE;
+    }
+    for (auto& thread : pool) {
+        thread.join();
+    }
+    writer.close();
+    report();
+    std::cout << "written to " << options.output << std::endl;
+}
+
+// Coefficients of the PST evaluation, from white's side. For a fixed
+// position evaluate_classical is linear in EvalParams, so its white score is
+// exactly the dot product of these with the parameter vector. `coef` has
+// EvalParams::COUNT entries and is added to.
+void eval_coefficients(const Board& board, int* coef) {
+    const EvalParams& p = eval_params;
+    bool endgame = count_pieces(board) <= 6;
+    
+    Bitboard occupied = board.occ();
+    while (occupied) {
+        Square square(occupied.pop());
+        Piece piece = board.at(square);
+        int sign = piece.color() == Color::WHITE ? 1 : -1;
+        int sq_index = piece.color() == Color::WHITE ? square.index() : 63 - square.index();
+        int mg_index, eg_index;
+        p.pst_entries(piece.type(), sq_index, mg_index, eg_index);
+        coef[static_cast<int>(piece.type().internal())] += sign;
+        coef[endgame ? eg_index : mg_index] += sign;
+    }
+    
+    coef[p.index_of(&p.pawn_bonus)] += board.pieces(PieceType::PAWN, Color::WHITE).count() -
+                                       board.pieces(PieceType::PAWN, Color::BLACK).count();
+    coef[p.index_of(&p.mobility_weight)] += mobility(board, Color::WHITE) - mobility(board, Color::BLACK);
+    
+    Color stm = board.sideToMove();
+    if (endgame) {
+        coef[p.index_of(&p.king_distance_weight)] += king_distance_term(board.kingSq(stm), board.kingSq(~stm));
+    }
+    if (board.inCheck()) {
+        coef[p.index_of(&p.check_penalty)] += stm == Color::WHITE ? -1 : 1;
+    }
+}
+
+// Texel tuning data: one sparse coefficient row per position, all rows in
+// one contiguous array. A dense row would be 2KB per position; the nonzero
+// entries of a typical position take well under 100 bytes.
+struct TuneEntry {
+    std::uint16_t index;
+    std::int16_t coef;
+};
+
+struct TuneSet {
+    std::vector<TuneEntry> entries;
+    std::vector<std::uint32_t> offsets{0};   // row i is entries[offsets[i], offsets[i + 1])
+    std::vector<float> targets;              // white's game result: 1, 0.5 or 0
+    
+    size_t size() const {
+        return targets.size();
+    }
+    
+    void add(const Board& board, float target) {
+        int coef[EvalParams::COUNT] = {};
+        eval_coefficients(board, coef);
+        for (int i = 0; i < EvalParams::COUNT; ++i) {
+            if (coef[i]) entries.push_back({static_cast<std::uint16_t>(i), static_cast<std::int16_t>(coef[i])});
         }
+        offsets.push_back(static_cast<std::uint32_t>(entries.size()));
+        targets.push_back(target);
+    }
+};
+
+// gensfen .bin files, or text with a FEN and a result per line; the result
+// is the last token: 1-0, 0-1, 1/2-1/2 or a white score 1.0/0.5/0.0, with
+// any brackets, quotes or semicolons around it.
+bool load_tune_set(const std::string& path, TuneSet& set, std::string& error) {
+    if (path.size() >= 4 && path.compare(path.size() - 4, 4, ".bin") == 0) {
+        std::FILE* file = std::fopen(path.c_str(), "rb");
+        if (!file) {
+            error = "cannot open " + path;
+            return false;
+        }
+        TrainingRecord record;
+        while (std::fread(&record, sizeof(record), 1, file) == 1) {
+            Board board = Board::Compact::decode(record.board);
+            int white = board.sideToMove() == Color::WHITE ? record.result : -record.result;
+            set.add(board, (white + 1) / 2.0f);
+        }
+        std::fclose(file);
+        return true;
+    }
+    
+    std::ifstream in(path);
+    if (!in) {
+        error = "cannot open " + path;
+        return false;
+    }
+    std::string line;
+    while (std::getline(in, line)) {
+        size_t cut = line.find_last_of(" \t");
+        if (cut == std::string::npos) continue;
+        std::string fen = line.substr(0, cut);
+        std::string result = line.substr(cut + 1);
+        result.erase(std::remove_if(result.begin(), result.end(),
+                                    [](char c) { return c == '[' || c == ']' || c == '"' || c == ';'; }),
+                     result.end());
         
-        order_moves(moves, tt_move);
-        
-        int best_score = -INF;
-        Move best_move = Move::NO_MOVE;
-        TTFlag flag = TT_ALPHA;
+        float target;
+        if (result == "1-0") target = 1.0f;
+        else if (result == "0-1") target = 0.0f;
+        else if (result == "1/2-1/2") target = 0.5f;
+        else if (!result.empty() && (std::isdigit(static_cast<unsigned char>(result[0])) || result[0] == '.')) target = std::stof(result);
+        else continue;
         
-        for (int i = 0; i < moves.size(); ++i) {
-            const Move& move = moves[i];
-            
-            board.makeMove(move);
+        Board board;
+        if (!board.setFen(fen)) continue;
+        set.add(board, target);
+    }
+    return true;
+}
+
+inline double texel_sigmoid(double score, double k) {
+    return 1.0 / (1.0 + std::pow(10.0, -k * score / 400.0));
+}
+
+// Mean squared error of the set against the sigmoid of the linear eval, and,
+// if `gradient` is given, its derivative per parameter. Rows are split over
+// `threads`; each sums into its own gradient, added up at the end.
+double tune_error(const TuneSet& set, const std::vector<double>& params, double k, int threads,
+                  std::vector<double>* gradient) {
+    std::vector<double> errors(threads, 0.0);
+    std::vector<std::vector<double>> gradients(gradient ? threads : 0, std::vector<double>(EvalParams::COUNT, 0.0));
+    std::vector<std::thread> pool;
+    size_t chunk = (set.size() + threads - 1) / threads;
+    
+    for (int t = 0; t < threads; ++t) {
+        pool.emplace_back([&, t] {
+            const double* theta = params.data();
+            double* grad = gradient ? gradients[t].data() : nullptr;
+            double error = 0.0;
+            size_t end = std::min(set.size(), (t + 1) * chunk);
             
-            int score;
-            if (i == 0) {
-                score = -negamax(depth - 1, -beta, -alpha, true);
-            } else {
-                score = -negamax(depth - 1, -alpha - 1, -alpha, true);
-                if (score > alpha && score < beta) {
-                    score = -negamax(depth - 1, -beta, -alpha, true);
+            for (size_t i = t * chunk; i < end; ++i) {
+                const TuneEntry* row = set.entries.data() + set.offsets[i];
+                int count = static_cast<int>(set.offsets[i + 1] - set.offsets[i]);
+                double score = 0.0;
+                for (int j = 0; j < count; ++j) {
+                    score += theta[row[j].index] * row[j].coef;
+                }
+                double s = texel_sigmoid(score, k);
+                double diff = set.targets[i] - s;
+                error += diff * diff;
+                if (grad) {
+                    double g = diff * s * (1.0 - s);
+                    for (int j = 0; j < count; ++j) {
+                        grad[row[j].index] += g * row[j].coef;
+                    }
                 }
             }
-            
-            board.unmakeMove(move);
-            
-            if (stop_search) return alpha;
-            
-            if (score > best_score) {
-                best_score = score;
-                best_move = move;
-            }
-            
-            if (score >= beta) {
-                tt.store(key, best_move, depth, beta, TT_BETA);
-                return beta;
+            errors[t] = error;
+        });
+    }
+    for (auto& thread : pool) {
+        thread.join();
+    }
+    
+    double n = static_cast<double>(std::max<size_t>(set.size(), 1));
+    if (gradient) {
+        gradient->assign(EvalParams::COUNT, 0.0);
+        double scale = -2.0 / n * k * std::log(10.0) / 400.0;
+        for (const auto& partial : gradients) {
+            for (int i = 0; i < EvalParams::COUNT; ++i) {
+                (*gradient)[i] += partial[i] * scale;
             }
-            
-            if (score > alpha) {
-                alpha = score;
-                flag = TT_EXACT;
+        }
+    }
+    double total = 0.0;
+    for (double error : errors) total += error;
+    return total / n;
+}
+
+void save_tuned(const std::vector<double>& params, const std::string& path) {
+    EvalParams rounded = eval_params;
+    for (int i = 0; i < EvalParams::COUNT; ++i) {
+        rounded.data()[i] = static_cast<int>(std::lround(params[i]));
+    }
+    rounded.save(path);
+}
+
+// ./chess_engine tune <data> [threads n] [epochs n] [rate cp] [params file] [output file]
+// Texel tuning of EvalParams: fits the sigmoid scale K to the starting
+// parameters, then runs full-batch Adam on the mean squared error between
+// game results and sigmoid(K * eval). `params` sets the starting point
+// (defaults otherwise); the result goes to `output` every 25 epochs.
+void run_tune(int argc, char* argv[]) {
+    if (argc < 3) {
+        std::cerr << "usage: tune <data> [threads n] [epochs n] [rate cp] [params file] [output file]" << std::endl;
+        return;
+    }
+    std::string data = argv[2];
+    int threads = 1, epochs = 300;
+    double rate = 1.0;
+    std::string output = "tuned.txt";
+    for (int i = 3; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if (arg == "threads") threads = std::clamp(std::stoi(argv[i + 1]), 1, MAX_THREADS);
+        else if (arg == "epochs") epochs = std::stoi(argv[i + 1]);
+        else if (arg == "rate") rate = std::stod(argv[i + 1]);
+        else if (arg == "output") output = argv[i + 1];
+        else if (arg == "params") {
+            std::string error;
+            if (!eval_params.load(argv[i + 1], error)) {
+                std::cerr << error << std::endl;
+                return;
             }
         }
+    }
+    
+    TuneSet set;
+    std::string error;
+    auto start = std::chrono::steady_clock::now();
+    if (!load_tune_set(data, set, error)) {
+        std::cerr << error << std::endl;
+        return;
+    }
+    double load_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "positions " << set.size() << " entries " << set.entries.size()
+              << " loaded in " << load_seconds << "s" << std::endl;
+    if (set.size() == 0) return;
+    
+    std::vector<double> params(eval_params.data(), eval_params.data() + EvalParams::COUNT);
+    
+    // The error is unimodal in K: ternary search.
+    double low = 0.1, high = 4.0;
+    for (int i = 0; i < 40; ++i) {
+        double a = low + (high - low) / 3, b = high - (high - low) / 3;
+        if (tune_error(set, params, a, threads, nullptr) < tune_error(set, params, b, threads, nullptr)) high = b;
+        else low = a;
+    }
+    double k = (low + high) / 2;
+    std::cout << "K " << k << " error " << tune_error(set, params, k, threads, nullptr) << std::endl;
+    
+    const double beta1 = 0.9, beta2 = 0.999, epsilon = 1e-8;
+    std::vector<double> gradient, m(EvalParams::COUNT, 0.0), v(EvalParams::COUNT, 0.0);
+    start = std::chrono::steady_clock::now();
+    for (int epoch = 1; epoch <= epochs; ++epoch) {
+        double error = tune_error(set, params, k, threads, &gradient);
+        for (int i = 0; i < EvalParams::COUNT; ++i) {
+            m[i] = beta1 * m[i] + (1 - beta1) * gradient[i];
+            v[i] = beta2 * v[i] + (1 - beta2) * gradient[i] * gradient[i];
+            double m_hat = m[i] / (1 - std::pow(beta1, epoch));
+            double v_hat = v[i] / (1 - std::pow(beta2, epoch));
+            params[i] -= rate * m_hat / (std::sqrt(v_hat) + epsilon);
+        }
         
-        tt.store(key, best_move, depth, best_score, flag);
-        return best_score;
+        if (epoch % 25 == 0 || epoch == epochs) {
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            std::cout << "epoch " << epoch << " error " << error << " time " << seconds << "s" << std::endl;
+            save_tuned(params, output);
+        }
+    }
+    std::cout << "written to " << output << std::endl;
+}
+
+// Plays `games` between two parameter files through cutechess-cli, the way
+// test_vs_stockfish.sh runs its matches, and returns the first engine's
+// wins minus losses. False if no score line came back.
+bool spsa_match(const std::string& command, int& wins, int& losses, int& draws) {
+    std::FILE* pipe = popen(command.c_str(), "r");
+    if (!pipe) return false;
+    bool ok = false;
+    char buffer[512];
+    while (std::fgets(buffer, sizeof(buffer), pipe)) {
+        int w, l, d;
+        const char* score = std::strstr(buffer, "Score of plus vs minus:");
+        if (score && std::sscanf(score, "Score of plus vs minus: %d - %d - %d", &w, &l, &d) == 3) {
+            wins = w;
+            losses = l;
+            draws = d;
+            ok = true;
+        }
+    }
+    pclose(pipe);
+    return ok;
+}
+
+// ./chess_engine spsa [iterations n] [games n] [concurrency n] [tc 10+0.1]
+//                     [tune name,name,...] [params file] [output file]
+//                     [openings file.epd] [cutechess path]
+// SPSA over a few EvalParams: each iteration perturbs every tuned value by
+// +-c at random, plays the two versions against each other and moves the
+// values toward the side that scored better. c starts at 5% of each value
+// (at least 1) and both c and the step shrink with the usual exponents.
+void run_spsa(int argc, char* argv[]) {
+    int iterations = 200, games = 64, concurrency = 2;
+    std::string tc = "10+0.1", output = "spsa.txt", openings, cutechess = "cutechess-cli";
+    std::string tune = "piece_values[0],piece_values[1],piece_values[2],piece_values[3],piece_values[4],"
+                       "pawn_bonus,mobility_weight,check_penalty,king_distance_weight";
+    for (int i = 2; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if (arg == "iterations") iterations = std::stoi(argv[i + 1]);
+        else if (arg == "games") games = std::max(2, std::stoi(argv[i + 1]) / 2 * 2);
+        else if (arg == "concurrency") concurrency = std::max(1, std::stoi(argv[i + 1]));
+        else if (arg == "tc") tc = argv[i + 1];
+        else if (arg == "tune") tune = argv[i + 1];
+        else if (arg == "output") output = argv[i + 1];
+        else if (arg == "openings") openings = argv[i + 1];
+        else if (arg == "cutechess") cutechess = argv[i + 1];
+        else if (arg == "params") {
+            std::string error;
+            if (!eval_params.load(argv[i + 1], error)) {
+                std::cerr << error << std::endl;
+                return;
+            }
+        }
     }
     
-    Move search(int max_depth = 10) {
-        stop_search = false;
-        nodes_searched = 0;
-        search_start = std::chrono::steady_clock::now();
+    std::vector<int> indices;
+    std::stringstream names(tune);
+    for (std::string name; std::getline(names, name, ',');) {
+        int found = -1;
+        for (int i = 0; i < EvalParams::COUNT; ++i) {
+            if (EvalParams::name(i) == name) found = i;
+        }
+        if (found < 0) {
+            std::cerr << "unknown parameter " << name << std::endl;
+            return;
+        }
+        indices.push_back(found);
+    }
+    
+    std::string self = argv[0];
+#ifdef __linux__
+    char exe[4096];
+    ssize_t length = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+    if (length > 0) self.assign(exe, static_cast<size_t>(length));
+#endif
+    
+    const EvalParams base = eval_params;
+    std::vector<double> theta, c;
+    for (int index : indices) {
+        theta.push_back(base.data()[index]);
+        c.push_back(std::max(1.0, std::abs(base.data()[index]) * 0.05));
+    }
+    
+    const double rate = 2.0, stability = 0.1 * iterations, alpha = 0.602, gamma = 0.101;
+    std::mt19937_64 rng(std::random_device{}());
+    
+    for (int k = 0; k < iterations; ++k) {
+        double a_k = rate * std::pow(stability + 1, alpha) / std::pow(stability + k + 1, alpha);
+        double c_scale = 1.0 / std::pow(k + 1, gamma);
         
-        Move best_move = Move::NO_MOVE;
+        EvalParams plus = base, minus = base;
+        std::vector<int> delta(indices.size());
+        for (size_t i = 0; i < indices.size(); ++i) {
+            delta[i] = rng() & 1 ? 1 : -1;
+            double shift = c[i] * c_scale * delta[i];
+            plus.data()[indices[i]] = static_cast<int>(std::lround(theta[i] + shift));
+            minus.data()[indices[i]] = static_cast<int>(std::lround(theta[i] - shift));
+        }
+        plus.save("spsa_plus.txt");
+        minus.save("spsa_minus.txt");
         
-        for (int depth = 1; depth <= max_depth && !stop_search; ++depth) {
-            int score = negamax(depth, -INF, INF);
-            
-            if (!stop_search) {
-                TTEntry* entry = tt.probe(board.hash());
-                if (entry && entry->best_move != Move::NO_MOVE) {
-                    best_move = entry->best_move;
-                }
-                
-                auto elapsed = std::chrono::steady_clock::now() - search_start;
-                auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count();
-                
-                std::cout << "info depth " << depth 
-                         << " score cp " << score
-                         << " nodes " << nodes_searched
-                         << " time " << ms
-                         << " pv " << uci::moveToUci(best_move) << std::endl;
-            }
+        std::string command = cutechess +
+            " -engine cmd=" + self + " name=plus option.EvalParams=spsa_plus.txt" +
+            " -engine cmd=" + self + " name=minus option.EvalParams=spsa_minus.txt" +
+            " -each proto=uci tc=" + tc +
+            " -games 2 -rounds " + std::to_string(games / 2) + " -repeat" +
+            " -concurrency " + std::to_string(concurrency) +
+            " -draw movenumber=50 movecount=5 score=5 -resign movecount=3 score=800";
+        if (!openings.empty()) {
+            command += " -openings file=" + openings + " format=epd order=random";
         }
+        command += " 2>&1";
         
-        if (best_move == Move::NO_MOVE || !is_move_legal(best_move)) {
-            best_move = get_first_legal_move();
+        int wins = 0, losses = 0, draws = 0;
+        if (!spsa_match(command, wins, losses, draws)) {
+            std::cerr << "no result from: " << command << std::endl;
+            return;
         }
         
-        return best_move;
+        double result = static_cast<double>(wins - losses) / std::max(1, wins + losses + draws);
+        for (size_t i = 0; i < indices.size(); ++i) {
+            theta[i] += a_k * c[i] * c_scale * result * delta[i];
+        }
+        
+        EvalParams current = base;
+        std::cout << "iteration " << k + 1 << " +" << wins << " -" << losses << " =" << draws;
+        for (size_t i = 0; i < indices.size(); ++i) {
+            current.data()[indices[i]] = static_cast<int>(std::lround(theta[i]));
+            std::cout << " " << EvalParams::name(indices[i]) << "=" << theta[i];
+        }
+        std::cout << std::endl;
+        current.save(output);
     }
+}
+
+#ifdef __linux__
+// A UCI engine on the other end of two pipes.
+class EngineProcess {
+private:
+    pid_t pid;
+    int to_engine;
+    int from_engine;
+    std::string buffer;
     
-    void set_time_limit(int ms) {
-        time_limit = std::chrono::milliseconds(ms);
+public:
+    EngineProcess() : pid(-1), to_engine(-1), from_engine(-1) {}
+    
+    ~EngineProcess() {
+        stop();
     }
     
-    void stop() {
-        stop_search = true;
+    EngineProcess(const EngineProcess&) = delete;
+    EngineProcess& operator=(const EngineProcess&) = delete;
+    
+    bool start(const std::string& path) {
+        int in_pipe[2], out_pipe[2];
+        if (pipe(in_pipe) != 0) return false;
+        if (pipe(out_pipe) != 0) {
+            close(in_pipe[0]);
+            close(in_pipe[1]);
+            return false;
+        }
+        
+        pid = fork();
+        if (pid == 0) {
+            dup2(in_pipe[0], STDIN_FILENO);
+            dup2(out_pipe[1], STDOUT_FILENO);
+            close(in_pipe[0]); close(in_pipe[1]);
+            close(out_pipe[0]); close(out_pipe[1]);
+            execl(path.c_str(), path.c_str(), static_cast<char*>(nullptr));
+            _exit(127);
+        }
+        
+        close(in_pipe[0]);
+        close(out_pipe[1]);
+        to_engine = in_pipe[1];
+        from_engine = out_pipe[0];
+        return pid > 0;
     }
     
-    std::string get_fen() const {
-        return board.getFen();
+    void send(const std::string& line) {
+        std::string data = line + "\n";
+        size_t sent = 0;
+        while (sent < data.size()) {
+            ssize_t n = write(to_engine, data.data() + sent, data.size() - sent);
+            if (n <= 0) return;
+            sent += static_cast<size_t>(n);
+        }
     }
     
-    int count_pieces() const {
-        int count = 0;
-        for (int sq = 0; sq < 64; ++sq) {
-            Square square(sq);
-            Piece piece = board.at(square);
-            if (piece != Piece::NONE && piece.type() != PieceType::PAWN && piece.type() != PieceType::KING) {
-                count++;
+    // False on timeout or when the engine has gone away.
+    bool read_line(std::string& line, std::int64_t timeout_ms) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+        while (true) {
+            size_t end = buffer.find('\n');
+            if (end != std::string::npos) {
+                line = buffer.substr(0, end);
+                if (!line.empty() && line.back() == '\r') line.pop_back();
+                buffer.erase(0, end + 1);
+                return true;
             }
+            
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+            if (left <= 0) return false;
+            pollfd fd = {from_engine, POLLIN, 0};
+            if (poll(&fd, 1, static_cast<int>(std::min<std::int64_t>(left, INT_MAX))) <= 0) continue;
+            
+            char chunk[4096];
+            ssize_t n = read(from_engine, chunk, sizeof(chunk));
+            if (n <= 0) return false;
+            buffer.append(chunk, static_cast<size_t>(n));
         }
-        return count;
     }
     
-    int calculate_mobility(Color color) const {
-        Movelist moves;
-        movegen::legalmoves(moves, board);
+    // Reads until a line starting with `prefix`.
+    bool wait_for(const std::string& prefix, std::string& line, std::int64_t timeout_ms) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+        while (true) {
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+            if (!read_line(line, std::max<std::int64_t>(left, 0))) return false;
+            if (line.compare(0, prefix.size(), prefix) == 0) return true;
+        }
+    }
+    
+    void stop() {
+        if (pid <= 0) return;
+        send("quit");
+        close(to_engine);
+        close(from_engine);
         
-        int mobility = 0;
-        for (const auto& move : moves) {
-            Piece piece = board.at(move.from());
-            if (piece.color() == color) {
-                mobility++;
-            }
-        }
-        return mobility;
-    }
-    
-    int calculate_king_distance_evaluation(Square friendly_king_sq, Square opponent_king_sq) const {
-        int friendly_file = friendly_king_sq.file();
-        int friendly_rank = friendly_king_sq.rank();
-        int opponent_file = opponent_king_sq.file();
-        int opponent_rank = opponent_king_sq.rank();
-
-        int opponentKingDstToCentreFile = std::max(3 - opponent_file, opponent_file - 4);
-        int opponentKingDstToCentreRank = std::max(3 - opponent_rank, opponent_rank - 4);
-        int opponentKingDstFromCentre = opponentKingDstToCentreFile + opponentKingDstToCentreRank;
-
-        int dstBetweenKingsFile = std::abs(friendly_file - opponent_file);
-        int dstBetweenKingsRank = std::abs(friendly_rank - opponent_rank);
-        int dstBetweenKings = dstBetweenKingsFile + dstBetweenKingsRank;
-
-        int evaluation = 0;
-        evaluation += opponentKingDstFromCentre;
-        evaluation += 14 - dstBetweenKings;
-        return evaluation * 10;
-    }
-};
-
-const int ChessEngine::piece_values[7] = {100, 320, 330, 500, 900, 20000, 0};
-
-const int ChessEngine::pst_pawn[64] = {
-     0,  0,  0,  0,  0,  0,  0,  0,
-    50, 50, 50, 50, 50, 50, 50, 50,
-    10, 10, 20, 30, 30, 20, 10, 10,
-     5,  5, 10, 25, 25, 10,  5,  5,
-     0,  0,  0, 20, 20,  0,  0,  0,
-     5, -5,-10,  0,  0,-10, -5,  5,
-     5, 10, 10,-20,-20, 10, 10,  5,
-     0,  0,  0,  0,  0,  0,  0,  0
-};
-
-const int ChessEngine::pst_knight[64] = {
-    -50,-40,-30,-30,-30,-30,-40,-50,
-    -40,-20,  0,  0,  0,  0,-20,-40,
-    -30,  0, 10, 15, 15, 10,  0,-30,
-    -30,  5, 15, 20, 20, 15,  5,-30,
-    -30,  0, 15, 20, 20, 15,  0,-30,
-    -30,  5, 10, 15, 15, 10,  5,-30,
-    -40,-20,  0,  5,  5,  0,-20,-40,
-    -50,-40,-30,-30,-30,-30,-40,-50
-};
-
-const int ChessEngine::pst_bishop[64] = {
-    -20,-10,-10,-10,-10,-10,-10,-20,
-    -10,  0,  0,  0,  0,  0,  0,-10,
-    -10,  0,  5, 10, 10,  5,  0,-10,
-    -10,  5,  5, 10, 10,  5,  5,-10,
-    -10,  0, 10, 10, 10, 10,  0,-10,
-    -10, 10, 10, 10, 10, 10, 10,-10,
-    -10,  5,  0,  0,  0,  0,  5,-10,
-    -20,-10,-10,-10,-10,-10,-10,-20
-};
-
-const int ChessEngine::pst_rook[64] = {
-     0,  0,  0,  0,  0,  0,  0,  0,
-     5, 10, 10, 10, 10, 10, 10,  5,
-    -5,  0,  0,  0,  0,  0,  0, -5,
-    -5,  0,  0,  0,  0,  0,  0, -5,
-    -5,  0,  0,  0,  0,  0,  0, -5,
-    -5,  0,  0,  0,  0,  0,  0, -5,
-    -5,  0,  0,  0,  0,  0,  0, -5,
-     0,  0,  0,  5,  5,  0,  0,  0
-};
-
-const int ChessEngine::pst_queen[64] = {
-    -20,-10,-10, -5, -5,-10,-10,-20,
-    -10,  0,  0,  0,  0,  0,  0,-10,
-    -10,  0,  5,  5,  5,  5,  0,-10,
-     -5,  0,  5,  5,  5,  5,  0, -5,
-      0,  0,  5,  5,  5,  5,  0, -5,
-    -10,  5,  5,  5,  5,  5,  0,-10,
-    -10,  0,  5,  0,  0,  0,  0,-10,
-    -20,-10,-10, -5, -5,-10,-10,-20
-};
-
-const int ChessEngine::pst_king[64] = {
-    -30,-40,-40,-50,-50,-40,-40,-30,
-    -30,-40,-40,-50,-50,-40,-40,-30,
-    -30,-40,-40,-50,-50,-40,-40,-30,
-    -30,-40,-40,-50,-50,-40,-40,-30,
-    -20,-30,-30,-40,-40,-30,-30,-20,
-    -10,-20,-20,-20,-20,-20,-20,-10,
-     20, 20,  0,  0,  0,  0, 20, 20,
-     20, 30, 10,  0,  0, 10, 30, 20
-};
-
-const int ChessEngine::pst_pawn_endgame[64] = {
-     0,  0,  0,  0,  0,  0,  0,  0,
-    80, 80, 80, 80, 80, 80, 80, 80,
-    60, 60, 60, 60, 60, 60, 60, 60,
-    40, 40, 40, 40, 40, 40, 40, 40,
-    20, 20, 20, 20, 20, 20, 20, 20,
-    10, 10, 10, 10, 10, 10, 10, 10,
-    10, 10, 10, 10, 10, 10, 10, 10,
-     0,  0,  0,  0,  0,  0,  0,  0
-};
-
-const int ChessEngine::pst_king_endgame[64] = {
-    -50,-30,-30,-30,-30,-30,-30,-50,
-    -30,-30,  0,  0,  0,  0,-30,-30,
-    -30,-10, 20, 30, 30, 20,-10,-30,
-    -30,-10, 30, 40, 40, 30,-10,-30,
-    -30,-10, 30, 40, 40, 30,-10,-30,
-    -30,-10, 20, 30, 30, 20,-10,-30,
-    -30,-20,-10,  0,  0,-10,-20,-30,
-    -50,-40,-30,-20,-20,-30,-40,-50
+        // Give it a moment to exit on its own before killing it.
+        for (int i = 0; i < 50 && waitpid(pid, nullptr, WNOHANG) == 0; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        if (waitpid(pid, nullptr, WNOHANG) == 0) {
+            kill(pid, SIGKILL);
+            waitpid(pid, nullptr, 0);
+        }
+        pid = -1;
+    }
 };
 
-class UCIInterface {
-private:
-    ChessEngine engine;
+struct MatchEngine {
+    std::string path;
+    std::vector<std::pair<std::string, std::string>> options;
+};
+
+struct MatchOptions {
+    MatchEngine engines[2];
+    int games = 1000;
+    int concurrency = 1;
+    std::int64_t base_ms = 10000;
+    std::int64_t increment_ms = 100;
+    std::int64_t time_margin_ms = 100;   // lag allowed past zero before a time loss
+    std::string openings;
+    double elo0 = 0.0, elo1 = 5.0, alpha = 0.05, beta = 0.05;
+    int max_plies = 600;
+};
+
+// From the first engine's point of view.
+enum MatchResult {
+    MATCH_LOSS = 0,
+    MATCH_DRAW = 1,
+    MATCH_WIN = 2
+};
+
+bool start_match_engine(EngineProcess& process, const MatchEngine& engine) {
+    std::string line;
+    if (!process.start(engine.path)) return false;
+    process.send("uci");
+    if (!process.wait_for("uciok", line, 10000)) return false;
+    for (const auto& option : engine.options) {
+        process.send("setoption name " + option.first + " value " + option.second);
+    }
+    process.send("isready");
+    return process.wait_for("readyok", line, 10000);
+}
+
+// Plays one game from `fen`. Losses on time, by an illegal or missing move
+// or by a crash count against the side to move. The result is from white's
+// side: 1, 0 or -1, with `reason` for the log.
+int play_match_game(EngineProcess* players[2], const std::string& fen, const MatchOptions& options,
+                    std::string& reason) {
+    Board board(fen);
+    std::string moves;
+    std::int64_t clock[2] = {options.base_ms, options.base_ms};
+    std::string line;
     
-public:
-    void run() {
-        std::string line;
+    for (int side = 0; side < 2; ++side) {
+        players[side]->send("ucinewgame");
+        players[side]->send("isready");
+        if (!players[side]->wait_for("readyok", line, 10000)) {
+            reason = "no readyok";
+            return side == 0 ? -1 : 1;
+        }
+    }
+    
+    for (int ply = 0; ply < options.max_plies; ++ply) {
+        auto over = board.isGameOver();
+        if (over.first != GameResultReason::NONE) {
+            if (over.first == GameResultReason::CHECKMATE) {
+                reason = "checkmate";
+                return board.sideToMove() == Color::WHITE ? -1 : 1;
+            }
+            reason = over.first == GameResultReason::STALEMATE ? "stalemate"
+                   : over.first == GameResultReason::INSUFFICIENT_MATERIAL ? "insufficient material"
+                   : over.first == GameResultReason::FIFTY_MOVE_RULE ? "50-move rule" : "repetition";
+            return 0;
+        }
         
-        while (std::getline(std::cin, line)) {
-            try {
-                std::istringstream iss(line);
-                std::string command;
-                iss >> command;
+        int side = board.sideToMove() == Color::WHITE ? 0 : 1;
+        int loss = side == 0 ? -1 : 1;
+        EngineProcess& player = *players[side];
+        player.send("position fen " + fen + (moves.empty() ? "" : " moves " + moves));
+        player.send("go wtime " + std::to_string(std::max<std::int64_t>(clock[0], 1)) +
+                    " btime " + std::to_string(std::max<std::int64_t>(clock[1], 1)) +
+                    " winc " + std::to_string(options.increment_ms) +
+                    " binc " + std::to_string(options.increment_ms));
+        
+        auto start = std::chrono::steady_clock::now();
+        bool answered = player.wait_for("bestmove", line, clock[side] + options.time_margin_ms);
+        std::int64_t used = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start).count();
+        clock[side] -= used;
+        if (!answered || clock[side] < -options.time_margin_ms) {
+            player.send("stop");
+            reason = answered ? "time forfeit" : "no bestmove";
+            return loss;
+        }
+        clock[side] += options.increment_ms;
+        
+        std::string_view rest = line;
+        uci_token(rest);
+        std::string move_text(uci_token(rest));
+        Move move = move_text.size() >= 4 ? uci::uciToMove(board, move_text) : Move(Move::NO_MOVE);
+        if (!is_legal_move(board, move)) {
+            reason = "illegal move " + move_text;
+            return loss;
+        }
+        board.makeMove(move);
+        if (!moves.empty()) moves += ' ';
+        moves += move_text;
+    }
+    reason = "move limit";
+    return 0;
+}
+
+// Opening positions: one FEN or EPD per line (EPD operations after the four
+// position fields are dropped).
+std::vector<std::string> load_openings(const std::string& path) {
+    std::vector<std::string> openings;
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line)) {
+        std::string_view rest = line;
+        std::string fields[6];
+        int count = 0;
+        for (std::string_view token = uci_token(rest); !token.empty() && count < 6; token = uci_token(rest)) {
+            fields[count++] = std::string(token);
+        }
+        if (count < 4) continue;
+        bool counters = count == 6 && std::isdigit(static_cast<unsigned char>(fields[4][0])) &&
+                                      std::isdigit(static_cast<unsigned char>(fields[5][0]));
+        std::string fen = fields[0] + " " + fields[1] + " " + fields[2] + " " + fields[3] +
+                          (counters ? " " + fields[4] + " " + fields[5] : " 0 1");
+        Board board;
+        if (board.setFen(fen)) openings.push_back(fen);
+    }
+    return openings;
+}
+
+// Elo difference for a mean score.
+inline double score_to_elo(double score) {
+    score = std::clamp(score, 1e-6, 1 - 1e-6);
+    return 400.0 * std::log10(score / (1.0 - score));
+}
+
+// Generalised SPRT on the trinomial results, logistic Elo: the normal
+// approximation of the log-likelihood ratio of elo1 against elo0. An
+// outcome that has not happened yet counts as half a game, so a one-sided
+// run still has a variance.
+double sprt_llr(int win_count, int loss_count, int draw_count, double elo0, double elo1) {
+    if (win_count + loss_count + draw_count == 0) return 0.0;
+    double wins = win_count ? win_count : 0.5;
+    double losses = loss_count ? loss_count : 0.5;
+    double draws = draw_count ? draw_count : 0.5;
+    double n = wins + losses + draws;
+    double mean = (wins + 0.5 * draws) / n;
+    double variance = (wins * (1 - mean) * (1 - mean) + losses * mean * mean + draws * (0.5 - mean) * (0.5 - mean)) / n;
+    double s0 = 1.0 / (1.0 + std::pow(10.0, -elo0 / 400.0));
+    double s1 = 1.0 / (1.0 + std::pow(10.0, -elo1 / 400.0));
+    return (s1 - s0) * (2 * mean - s0 - s1) * n / (2 * variance);
+}
+
+// ./chess_engine match <engine1> <engine2> [games n] [concurrency n] [tc 10+0.1]
+//                      [openings file] [elo0 x] [elo1 x] [alpha x] [beta x]
+//                      [option1.<name> value] [option2.<name> value]
+// Plays engine1 against engine2 over UCI pipes, one game per worker thread
+// with its own pair of engine processes. Each opening is played twice with
+// colours reversed. After every game it prints the score, the Elo estimate
+// and the SPRT log-likelihood ratio, and stops when the LLR leaves
+// [log(beta / (1 - alpha)), log((1 - beta) / alpha)].
+void run_match(int argc, char* argv[]) {
+    if (argc < 4) {
+        std::cerr << "usage: match <engine1> <engine2> [games n] [concurrency n] [tc base+inc] [openings file]"
+                     " [elo0 x] [elo1 x] [alpha x] [beta x] [option1.<name> value] [option2.<name> value]" << std::endl;
+        return;
+    }
+    
+    MatchOptions options;
+    options.engines[0].path = argv[2];
+    options.engines[1].path = argv[3];
+    for (int i = 4; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        std::string value = argv[i + 1];
+        if (arg == "games") options.games = std::stoi(value);
+        else if (arg == "concurrency") options.concurrency = std::clamp(std::stoi(value), 1, MAX_THREADS);
+        else if (arg == "openings") options.openings = value;
+        else if (arg == "elo0") options.elo0 = std::stod(value);
+        else if (arg == "elo1") options.elo1 = std::stod(value);
+        else if (arg == "alpha") options.alpha = std::stod(value);
+        else if (arg == "beta") options.beta = std::stod(value);
+        else if (arg == "tc") {
+            size_t plus = value.find('+');
+            options.base_ms = static_cast<std::int64_t>(std::stod(value.substr(0, plus)) * 1000);
+            options.increment_ms = plus == std::string::npos ? 0
+                                 : static_cast<std::int64_t>(std::stod(value.substr(plus + 1)) * 1000);
+        }
+        else if (arg.compare(0, 8, "option1.") == 0) options.engines[0].options.emplace_back(arg.substr(8), value);
+        else if (arg.compare(0, 8, "option2.") == 0) options.engines[1].options.emplace_back(arg.substr(8), value);
+    }
+    
+    std::vector<std::string> openings;
+    if (!options.openings.empty()) {
+        openings = load_openings(options.openings);
+        if (openings.empty()) {
+            std::cerr << "no positions in " << options.openings << std::endl;
+            return;
+        }
+    } else {
+        openings.push_back(constants::STARTPOS);
+        std::cerr << "no openings given: every pair of games starts from the initial position" << std::endl;
+    }
+    
+    // A crashed engine must not take the runner down with it.
+    signal(SIGPIPE, SIG_IGN);
+    
+    const double lower = std::log(options.beta / (1 - options.alpha));
+    const double upper = std::log((1 - options.beta) / options.alpha);
+    std::atomic<int> next_game(0);
+    std::atomic<bool> decided(false);
+    std::mutex results_mutex;
+    int results[3] = {0, 0, 0};
+    
+    auto report = [&](int game, const std::string& line) {
+        int wins = results[MATCH_WIN], losses = results[MATCH_LOSS], draws = results[MATCH_DRAW];
+        int n = wins + losses + draws;
+        double mean = (wins + 0.5 * draws) / n;
+        double variance = (wins * (1 - mean) * (1 - mean) + losses * mean * mean + draws * (0.5 - mean) * (0.5 - mean)) / n;
+        double margin = 1.96 * std::sqrt(variance / n);
+        double llr = sprt_llr(wins, losses, draws, options.elo0, options.elo1);
+        
+        std::printf("game %d %s | %d: +%d -%d =%d  elo %.1f +- %.1f  LLR %.2f [%.2f, %.2f]\n", game, line.c_str(),
+                    n, wins, losses, draws, score_to_elo(mean),
+                    (score_to_elo(mean + margin) - score_to_elo(mean - margin)) / 2, llr, lower, upper);
+        std::fflush(stdout);
+        if (llr <= lower || llr >= upper) decided = true;
+    };
+    
+    std::vector<std::thread> pool;
+    for (int t = 0; t < options.concurrency; ++t) {
+        pool.emplace_back([&] {
+            EngineProcess processes[2];
+            bool started[2] = {false, false};
+            
+            while (!decided) {
+                int game = next_game++;
+                if (game >= options.games) break;
                 
-                if (command == "uci") {
-                    std::cout << "id name ChessEngine" << std::endl;
-                    std::cout << "id author Assistant" << std::endl;
-                    std::cout << "uciok" << std::endl;
-                }
-                else if (command == "isready") {
-                    std::cout << "readyok" << std::endl;
-                }
-                else if (command == "ucinewgame") {
-                    engine.new_game();
-                }
-                else if (command == "position") {
-                    std::string type;
-                    iss >> type;
-                    
-                    if (type == "startpos") {
-                        engine.set_position(constants::STARTPOS);
-                        
-                        std::string moves_token;
-                        if (iss >> moves_token && moves_token == "moves") {
-                            std::string move;
-                            while (iss >> move) {
-                                engine.make_move(move);
-                            }
-                        }
-                    }
-                    else if (type == "fen") {
-                        std::string fen;
-                        std::string token;
-                        for (int i = 0; i < 6 && iss >> token; ++i) {
-                            if (i > 0) fen += " ";
-                            fen += token;
-                        }
-                        engine.set_position(fen);
-                        
-                        std::string moves_token;
-                        if (iss >> moves_token && moves_token == "moves") {
-                            std::string move;
-                            while (iss >> move) {
-                                engine.make_move(move);
-                            }
+                for (int e = 0; e < 2; ++e) {
+                    if (!started[e]) {
+                        started[e] = start_match_engine(processes[e], options.engines[e]);
+                        if (!started[e]) {
+                            std::cerr << "cannot start " << options.engines[e].path << std::endl;
+                            decided = true;
+                            return;
                         }
                     }
                 }
-                else if (command == "go") {
-                    int depth = 10;
-                    int movetime = 5000;
-                    
-                    std::string param;
-                    while (iss >> param) {
-                        if (param == "depth") {
-                            iss >> depth;
-                        }
-                        else if (param == "movetime") {
-                            iss >> movetime;
-                            engine.set_time_limit(movetime);
-                        }
-                        else if (param == "wtime" || param == "btime") {
-                            int time;
-                            iss >> time;
-                            engine.set_time_limit(time / 20);
-                        }
-                    }
-                    
-                    Move best_move = engine.search(depth);
-                    
-                    if (best_move == Move::NO_MOVE) {
-                        std::cerr << "No legal move found!" << std::endl;
-                        best_move = engine.get_first_legal_move();
-                    }
-                    
-                    if (best_move != Move::NO_MOVE) {
-                        std::cout << "bestmove " << uci::moveToUci(best_move) << std::endl;
-                    } else {
-                        std::cerr << "No legal moves available!" << std::endl;
-                        std::cout << "bestmove 0000" << std::endl;
+                
+                bool first_white = game % 2 == 0;
+                EngineProcess* players[2] = {&processes[first_white ? 0 : 1], &processes[first_white ? 1 : 0]};
+                std::string reason;
+                int white = play_match_game(players, openings[(game / 2) % openings.size()], options, reason);
+                int first = first_white ? white : -white;
+                
+                // An engine that lost by crashing or hanging is restarted.
+                if (reason == "no bestmove" || reason == "no readyok") {
+                    for (int e = 0; e < 2; ++e) {
+                        processes[e].stop();
+                        started[e] = false;
                     }
                 }
-                else if (command == "stop") {
-                    engine.stop();
-                }
-                else if (command == "quit") {
-                    break;
-                }
-            } catch (const std::exception& e) {
-                std::cerr << "UCI Error: " << e.what() << std::endl;
+                
+                std::lock_guard<std::mutex> lock(results_mutex);
+                results[first + 1]++;
+                const char* score = white > 0 ? "1-0" : white < 0 ? "0-1" : "1/2-1/2";
+                report(game + 1, std::string(first_white ? "engine1-engine2 " : "engine2-engine1 ") + score +
+                                 " (" + reason + ")");
             }
-        }
+        });
     }
-};
+    for (auto& thread : pool) {
+        thread.join();
+    }
+    
+    double llr = sprt_llr(results[MATCH_WIN], results[MATCH_LOSS], results[MATCH_DRAW], options.elo0, options.elo1);
+    std::cout << "SPRT: " << (llr >= upper ? "H1 accepted (engine1 is stronger by elo1)"
+                            : llr <= lower ? "H0 accepted (engine1 is not stronger than elo0)"
+                            : "inconclusive") << std::endl;
+}
+#else
+void run_match(int, char*[]) {
+    std::cerr << "match needs POSIX pipes (Linux build)" << std::endl;
+}
+#endif
 
-int main() {
+int main(int argc, char* argv[]) {
     attacks::initAttacks();
+    init_search_tables();
+    
+    if (argc > 1 && std::string(argv[1]) == "ttbench") {
+        int size_mb = argc > 2 ? std::stoi(argv[2]) : 256;
+        int depth = argc > 3 ? std::stoi(argv[3]) : 9;
+        run_tt_bench(size_mb, depth);
+        return 0;
+    }
+    
+    if (argc > 1 && std::string(argv[1]) == "perft") {
+        run_perft(argc, argv);
+        return 0;
+    }
+    
+    if (argc > 1 && std::string(argv[1]) == "movegenbench") {
+        run_movegen_bench();
+        return 0;
+    }
+    
+    if (argc > 1 && std::string(argv[1]) == "nnuecheck") {
+        return run_nnue_check(argc, argv);
+    }
+    
+    if (argc > 1 && std::string(argv[1]) == "tbprobe") {
+        return run_tb_probe(argc, argv);
+    }
+    
+    if (argc > 1 && std::string(argv[1]) == "gensfen") {
+        run_gensfen(argc, argv);
+        return 0;
+    }
+    
+    if (argc > 1 && std::string(argv[1]) == "tune") {
+        run_tune(argc, argv);
+        return 0;
+    }
+    
+    if (argc > 1 && std::string(argv[1]) == "spsa") {
+        run_spsa(argc, argv);
+        return 0;
+    }
+    
+    if (argc > 1 && std::string(argv[1]) == "match") {
+        run_match(argc, argv);
+        return 0;
+    }
+    
+    if (argc > 1 && std::string(argv[1]) == "bench") {
+        int depth = argc > 2 ? std::stoi(argv[2]) : 10;
+        int threads = argc > 3 ? std::stoi(argv[3]) : 1;
+        int hash_mb = argc > 4 ? std::stoi(argv[4]) : 16;
+        run_bench(depth, threads, hash_mb);
+        return 0;
+    }
     
     UCIInterface uci;
     uci.run();
@@ -1,8 +1,9 @@
 #!/bin/bash
 
 # Systematic test script for MyEngine vs Stockfish using cutechess-cli
-# Usage: ./test_vs_stockfish.sh [games] [time_control] [stockfish_skill]
-# Example: ./test_vs_stockfish.sh 20 5+0 8
+# Usage: ./test_vs_stockfish.sh [games] [time_control] [stockfish_elo]
+# Example: ./test_vs_stockfish.sh 20 5+0 1500
+# For SPRT testing use the built-in runner: ./chess_engine match <engine1> <engine2> ...
 
 ENGINE_PATH="./chess_engine"
 STOCKFISH_PATH="stockfish"  # Change if not in PATH
@@ -10,7 +11,7 @@ CUTECHESS="cutechess-cli"    # Change if not in PATH
 
 GAMES="${1:-20}"
 TC="${2:-5+0}"
-SKILL="${3:-8}"
+SKILL="${3:-1500}"
 PGN_FILE="test_vs_stockfish_$(date +%Y%m%d_%H%M%S).pgn"
 LOG_FILE="test_vs_stockfish_$(date +%Y%m%d_%H%M%S).log"
 
@@ -19,7 +20,7 @@ echo "========================================="
 echo "Testing MyEngine vs Stockfish"
 echo "Games:         $GAMES"
 echo "Time control:  $TC"
-echo "Stockfish skill: $ELO"
+echo "Stockfish Elo: $SKILL"
 echo "PGN output:    $PGN_FILE"
 echo "========================================="
 
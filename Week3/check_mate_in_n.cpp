@@ -1,131 +1,392 @@
 #include <iostream>
 #include <string>
 #include <vector>
-#include <unordered_map>
-#include <limits>
+#include <memory>
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <atomic>
+#include <chrono>
 #include "chess.hpp"
 
 using namespace chess;
 
-// Only store evaluation values in the transposition table
-std::unordered_map<std::string, int> board_positions_val_dict;
-std::vector<std::vector<Move>> visited_histories_list;
+enum Bound : std::uint8_t { BOUND_NONE, BOUND_EXACT, BOUND_LOWER, BOUND_UPPER };
 
-class ChessHistory {
+// Fixed-size transposition table keyed by the board's Zobrist hash. Each
+// entry keeps the value with the remaining depth it was searched to and
+// whether it is exact or only a bound of the alpha-beta window.
+class MateTable {
 private:
-    Board board;
-    std::vector<Move> history;
-    int max_depth;
+    struct Entry {
+        std::uint64_t key;
+        std::int8_t value;
+        std::int8_t depth;
+        Bound bound;
+    };
+
+    std::vector<Entry> entries;
+    std::uint64_t mask;
 
 public:
-    ChessHistory(const std::string& fen, int depth) : board(fen), max_depth(depth) {}
+    // size_log2 = 20 gives 2^20 entries (16 MB)
+    explicit MateTable(int size_log2 = 20)
+        : entries(std::size_t(1) << size_log2, Entry{0, 0, -1, BOUND_NONE}), mask((std::uint64_t(1) << size_log2) - 1) {}
 
-    std::string get_board_str() const {
-        return board.getFen();
+    void clear() {
+        for (auto& entry : entries) {
+            entry = Entry{0, 0, -1, BOUND_NONE};
+        }
     }
 
-    bool is_terminal() const {
-        return board.isGameOver().first != GameResultReason::NONE || history.size() >= max_depth;
-    }
+    // Returns true and sets value if the entry settles this node. An entry
+    // searched to the same depth always applies. A forced mate either way
+    // stays forced with more plies, so a shallower entry is reused only when
+    // it is decisive; no mate within more plies means none within fewer, so
+    // a deeper entry is reused only when it is 0.
+    bool probe(std::uint64_t key, int depth, int alpha, int beta, int& value) const {
+        const Entry& entry = entries[key & mask];
+        if (entry.bound == BOUND_NONE || entry.key != key) return false;
+        if (entry.depth < depth && entry.value == 0) return false;
+        if (entry.depth > depth && entry.value != 0) return false;
 
-    int get_value() const {
-        auto [reason, result] = board.isGameOver();
-        if (reason == GameResultReason::CHECKMATE) {
-            return board.sideToMove() == Color::WHITE ? -1 : 1;
+        if (entry.bound == BOUND_EXACT ||
+            (entry.bound == BOUND_LOWER && entry.value >= beta) ||
+            (entry.bound == BOUND_UPPER && entry.value <= alpha)) {
+            value = entry.value;
+            return true;
         }
-        return 0; // Draw or max depth reached
+        return false;
     }
 
-    std::vector<Move> get_valid_moves() const {
-        Movelist moves;
-        movegen::legalmoves(moves, board);
-        return std::vector<Move>(moves.begin(), moves.end());
+    // Keeps the deeper result when two positions share a slot.
+    void store(std::uint64_t key, int depth, int value, Bound bound) {
+        Entry& entry = entries[key & mask];
+        if (entry.key != key && entry.depth > depth) return;
+        entry = Entry{key, static_cast<std::int8_t>(value), static_cast<std::int8_t>(depth), bound};
+    }
+};
+
+// Proof and disproof numbers for df-pn, stored per (position, remaining
+// depth) as phi/delta of the side to move: phi = 0 means the side to move
+// reaches its goal (mate for the attacker, survival for the defender).
+class ProofTable {
+private:
+    struct Entry {
+        std::uint64_t key;
+        std::uint32_t phi;
+        std::uint32_t delta;
+        std::int8_t depth;
+    };
+
+    std::vector<Entry> entries;
+    std::uint64_t mask;
+
+    static std::uint64_t slot_key(std::uint64_t key, int depth) {
+        return key ^ (std::uint64_t(depth) * 0x9E3779B97F4A7C15ULL);
     }
 
-    ChessHistory make_move(const Move& move) const {
-        ChessHistory new_history = *this;
-        new_history.board.makeMove(move);
-        new_history.history.push_back(move);
-        return new_history;
+public:
+    explicit ProofTable(int size_log2 = 20)
+        : entries(std::size_t(1) << size_log2, Entry{0, 0, 0, -1}), mask((std::uint64_t(1) << size_log2) - 1) {}
+
+    bool lookup(std::uint64_t key, int depth, std::uint32_t& phi, std::uint32_t& delta) const {
+        const Entry& entry = entries[slot_key(key, depth) & mask];
+        if (entry.key != key || entry.depth != depth) return false;
+        phi = entry.phi;
+        delta = entry.delta;
+        return true;
     }
 
-    const std::vector<Move>& get_history() const {
-        return history;
+    void store(std::uint64_t key, int depth, std::uint32_t phi, std::uint32_t delta) {
+        entries[slot_key(key, depth) & mask] = Entry{key, phi, delta, static_cast<std::int8_t>(depth)};
     }
 };
 
-std::pair<int, std::vector<Move>> alpha_beta_pruning(const ChessHistory& history, int alpha, int beta, bool max_player, int depth) {
-    // Check if position was already evaluated
-    auto it = board_positions_val_dict.find(history.get_board_str());
-    if (it != board_positions_val_dict.end()) {
-        return {it->second, {}}; // Return empty move list for non-winning positions
-    }
-
-    visited_histories_list.push_back(history.get_history());
-
-    if (history.is_terminal() || depth == 0) {
-        int value = history.get_value();
-        board_positions_val_dict[history.get_board_str()] = value;
-        return {value, {}}; // Return empty move list for non-winning positions
-    }
-
-    if (max_player) {
-        int best_value = std::numeric_limits<int>::min();
-        std::vector<Move> best_moves;
-        
-        for (const auto& move : history.get_valid_moves()) {
-            ChessHistory new_history = history.make_move(move);
-            auto [value, moves] = alpha_beta_pruning(new_history, alpha, beta, false, depth - 1);
-            
-            if (value > best_value) {
-                best_value = value;
-                // Only store moves if we found a winning solution
-                if (value == 1) {
-                    best_moves = moves;
-                    best_moves.insert(best_moves.begin(), move);
-                }
+const int MAX_MATE_PLY = 64;
+const std::uint32_t PN_INF = 1u << 30;
+
+Bound bound_for(int value, int alpha, int beta) {
+    if (value <= alpha) return BOUND_UPPER;
+    if (value >= beta) return BOUND_LOWER;
+    return BOUND_EXACT;
+}
+
+// Depth-limited negamax over a single board. Values are from the side to
+// move: 1 if it mates within the remaining plies, -1 if it gets mated, 0
+// otherwise. Moves are made and unmade in place and each ply generates into
+// its own slot of a fixed move stack, so a node allocates nothing.
+class MateSolver {
+private:
+    Board board;
+    MateTable table;
+    Movelist move_stack[MAX_MATE_PLY];
+    Move pv_table[MAX_MATE_PLY][MAX_MATE_PLY];
+    int pv_length[MAX_MATE_PLY];
+    std::uint64_t nodes;
+
+    // df-pn state, only allocated for --pns
+    std::unique_ptr<ProofTable> proof_table;
+    std::uint32_t child_phi[MAX_MATE_PLY][256];
+    std::uint32_t child_delta[MAX_MATE_PLY][256];
+    Movelist generated;
+
+    void update_pv(int ply, Move move) {
+        pv_table[ply][ply] = move;
+        for (int i = ply + 1; i < pv_length[ply + 1]; ++i) {
+            pv_table[ply][i] = pv_table[ply + 1][i];
+        }
+        pv_length[ply] = std::max(pv_length[ply + 1], ply + 1);
+    }
+
+    int alpha_beta(int depth, int alpha, int beta, int ply) {
+        ++nodes;
+        pv_length[ply] = ply;
+        Movelist& moves = move_stack[ply];
+
+        // Out of plies: only a mate on the board counts
+        if (depth == 0) {
+            if (!board.inCheck()) return 0;
+            movegen::legalmoves(moves, board);
+            return moves.empty() ? -1 : 0;
+        }
+
+        const std::uint64_t key = board.hash();
+        const int alpha_orig = alpha;
+
+        // The root always searches so that it has a move to report
+        int cached_value;
+        if (ply > 0 && table.probe(key, depth, alpha, beta, cached_value)) {
+            return cached_value;
+        }
+
+        bool any_legal = generate_moves(moves, depth, (ply & 1) == 0);
+        if (moves.empty()) {
+            int value = !any_legal && board.inCheck() ? -1 : 0;
+            table.store(key, depth, value, BOUND_EXACT);
+            return value;
+        }
+
+        int best_value = -2;
+        for (const Move move : moves) {
+            board.makeMove(move);
+            int value = -alpha_beta(depth - 1, -beta, -alpha, ply + 1);
+            board.unmakeMove(move);
+
+            best_value = std::max(best_value, value);
+            if (value > alpha) {
+                alpha = value;
+                update_pv(ply, move);
             }
-            
-            alpha = std::max(alpha, best_value);
             if (alpha >= beta) {
                 break;
             }
         }
-        
-        board_positions_val_dict[history.get_board_str()] = best_value;
-        return {best_value, best_moves};
-    } else {
-        int best_value = std::numeric_limits<int>::max();
-        std::vector<Move> best_moves;
-        
-        for (const auto& move : history.get_valid_moves()) {
-            ChessHistory new_history = history.make_move(move);
-            auto [value, moves] = alpha_beta_pruning(new_history, alpha, beta, true, depth - 1);
-            
-            if (value < best_value) {
-                best_value = value;
-                // Only store moves if we found a winning solution
-                if (value == -1) {
-                    best_moves = moves;
-                    best_moves.insert(best_moves.begin(), move);
-                }
+
+        table.store(key, depth, best_value, bound_for(best_value, alpha_orig, beta));
+        return best_value;
+    }
+
+    // Squares the defender's king could flee to after its move, counted with
+    // the king still on its square
+    int king_flights_after(Move move) {
+        const Color defender = board.sideToMove();
+        board.makeMove(move);
+        Square king = board.kingSq(defender);
+        Bitboard flights = attacks::king(king) & ~board.us(defender);
+        int count = 0;
+        while (flights) {
+            if (!board.isAttacked(Square(flights.pop()), ~defender)) ++count;
+        }
+        board.unmakeMove(move);
+        return count;
+    }
+
+    // Attacker moves go checks, captures, then quiet moves, and on the last
+    // attacking ply only checks are kept, as nothing else can mate. Defender
+    // replies that leave the king the most flight squares go first, as they
+    // are the likeliest refutations. Returns false if the side to move has
+    // no legal move at all, which an empty list alone does not tell when
+    // quiet moves were dropped.
+    bool generate_moves(Movelist& moves, int depth, bool attacker) {
+        movegen::legalmoves(generated, board);
+        moves.clear();
+        for (Move move : generated) {
+            if (attacker) {
+                bool check = board.givesCheck(move) != CheckType::NO_CHECK;
+                if (depth == 1 && !check) continue;
+                move.setScore(check ? 2 : board.isCapture(move) ? 1 : 0);
+            } else {
+                move.setScore(king_flights_after(move));
             }
-            
-            beta = std::min(beta, best_value);
-            if (alpha >= beta) {
-                break;
+            moves.add(move);
+        }
+        std::stable_sort(moves.begin(), moves.end(),
+                         [](const Move& a, const Move& b) { return a.score() > b.score(); });
+        return !generated.empty();
+    }
+
+    // Plays the root PV onto the board and returns the plies left.
+    int play_pv(int remaining, std::vector<Move>& line) {
+        for (int i = 0; i < pv_length[0]; ++i) {
+            line.push_back(pv_table[0][i]);
+            board.makeMove(pv_table[0][i]);
+        }
+        return remaining - pv_length[0];
+    }
+
+    bool has_legal_moves() {
+        Movelist moves;
+        movegen::legalmoves(moves, board);
+        return !moves.empty();
+    }
+
+    // Table cutoffs can end a PV early; search again from where it stops
+    // until the mate is on the board
+    void complete_line(int remaining, std::vector<Move>& line) {
+        while (remaining > 0 && has_legal_moves()) {
+            alpha_beta(remaining, -2, 2, 0);
+            remaining = play_pv(remaining, line);
+        }
+    }
+
+    // Depth-first proof-number search (Nagai's df-pn) in phi/delta form.
+    // A node is searched until its phi or delta reaches the thresholds handed
+    // down by its parent; the child searched next is always the one with the
+    // smallest delta, i.e. the most-proving node. The attacker moves at even
+    // plies and the defender at odd ones.
+    void mid(int depth, int ply, std::uint32_t th_phi, std::uint32_t th_delta,
+             std::uint32_t& phi, std::uint32_t& delta) {
+        ++nodes;
+        const bool attacker = (ply & 1) == 0;
+        const std::uint64_t key = board.hash();
+        Movelist& moves = move_stack[ply];
+        if (depth > 0) {
+            generate_moves(moves, depth, attacker);
+        } else {
+            movegen::legalmoves(moves, board);
+        }
+
+        // Mated or stalemated, out of plies, or an attacker with no check on
+        // its last move: the defender reaches its goal unless it is mated
+        if (moves.empty() || depth == 0) {
+            bool mover_wins = !attacker && !(moves.empty() && board.inCheck());
+            phi = mover_wins ? 0 : PN_INF;
+            delta = mover_wins ? PN_INF : 0;
+            proof_table->store(key, depth, phi, delta);
+            return;
+        }
+
+        // Unknown children start at 1/1; at attacker nodes a quiet move counts
+        // as twice as hard to prove as a check
+        std::uint32_t* cphi = child_phi[ply];
+        std::uint32_t* cdelta = child_delta[ply];
+        for (int i = 0; i < moves.size(); ++i) {
+            bool quiet = attacker && board.givesCheck(moves[i]) == CheckType::NO_CHECK;
+            board.makeMove(moves[i]);
+            if (!proof_table->lookup(board.hash(), depth - 1, cphi[i], cdelta[i])) {
+                cphi[i] = 1;
+                cdelta[i] = quiet ? 2 : 1;
+            }
+            board.unmakeMove(moves[i]);
+        }
+
+        while (true) {
+            // phi = min over children of their delta, delta = sum of their phi
+            int best = 0;
+            std::uint32_t second = PN_INF;
+            std::uint64_t sum = 0;
+            bool infinite = false;
+            for (int i = 0; i < moves.size(); ++i) {
+                if (cdelta[i] < cdelta[best]) {
+                    second = cdelta[best];
+                    best = i;
+                } else if (i != best && cdelta[i] < second) {
+                    second = cdelta[i];
+                }
+                infinite |= cphi[i] >= PN_INF;
+                sum += cphi[i];
             }
+            phi = cdelta[best];
+            delta = infinite ? PN_INF : static_cast<std::uint32_t>(std::min<std::uint64_t>(sum, PN_INF - 1));
+
+            if (phi >= th_phi || delta >= th_delta) break;
+
+            std::uint32_t child_th_phi = th_delta - delta + cphi[best];
+            std::uint32_t child_th_delta = std::min(th_phi, second + 1);
+            board.makeMove(moves[best]);
+            mid(depth - 1, ply + 1, child_th_phi, child_th_delta, cphi[best], cdelta[best]);
+            board.unmakeMove(moves[best]);
         }
-        
-        board_positions_val_dict[history.get_board_str()] = best_value;
-        return {best_value, best_moves};
+
+        proof_table->store(key, depth, phi, delta);
     }
-}
 
-std::pair<int, std::vector<Move>> solve_mate_in_n(const std::string& fen, int depth) {
-    ChessHistory history(fen, depth);
-    return alpha_beta_pruning(history, std::numeric_limits<int>::min(), std::numeric_limits<int>::max(), true, depth);
-}
+public:
+    MateSolver() : nodes(0) {}
+
+    std::uint64_t node_count() const {
+        return nodes;
+    }
+
+    // Returns 1 with the mating line in `line` if the side to move mates
+    // within `depth` plies.
+    int solve(const std::string& fen, int depth, std::vector<Move>& line) {
+        board.setFen(fen);
+        nodes = 0;
+        line.clear();
+
+        int value = alpha_beta(depth, -2, 2, 0);
+        if (value == 1) {
+            complete_line(play_pv(depth, line), line);
+        }
+        return value;
+    }
+
+    // Same contract as solve(), using df-pn. The line follows proven children
+    // in the proof table; where an entry has been overwritten the rest of
+    // the line comes from alpha-beta.
+    int solve_pns(const std::string& fen, int depth, std::vector<Move>& line) {
+        if (!proof_table) proof_table = std::make_unique<ProofTable>();
+        board.setFen(fen);
+        nodes = 0;
+        line.clear();
+
+        std::uint32_t phi, delta;
+        mid(depth, 0, PN_INF, PN_INF, phi, delta);
+        if (phi != 0) return 0;
+
+        for (int ply = 0; depth - ply > 0; ++ply) {
+            Movelist moves;
+            movegen::legalmoves(moves, board);
+            if (moves.empty()) return 1;
+
+            // A proven attacker move leaves the defender with delta 0; every
+            // defender reply leaves the attacker with phi 0
+            Move next = Move::NO_MOVE;
+            for (const Move move : moves) {
+                std::uint32_t child_phi_value, child_delta_value;
+                board.makeMove(move);
+                bool found = proof_table->lookup(board.hash(), depth - ply - 1, child_phi_value, child_delta_value);
+                board.unmakeMove(move);
+                if (found && ((ply & 1) == 0 ? child_delta_value == 0 : child_phi_value == 0)) {
+                    next = move;
+                    break;
+                }
+            }
+
+            if (next == Move::NO_MOVE) {
+                complete_line(depth - ply, line);
+                return 1;
+            }
+            line.push_back(next);
+            board.makeMove(next);
+        }
+        return 1;
+    }
+};
 
 void print_moves(const std::vector<Move>& moves, const Board& board) {
     Board temp_board = board;
@@ -136,19 +397,224 @@ void print_moves(const std::vector<Move>& moves, const Board& board) {
     std::cout << std::endl;
 }
 
+// One puzzle from an m8nX.txt file: the FEN line and the solution line
+// printed under it, e.g. "1. Nf6+ gxf6 2. Bxf7#".
+struct Puzzle {
+    std::string fen;
+    std::string solution;
+    int mate_in;
+};
+
+struct PuzzleResult {
+    bool solved = false;
+    std::string line;
+    std::uint64_t nodes = 0;
+    double ms = 0;
+};
+
+bool looks_like_fen(const std::string& line) {
+    std::istringstream iss(line);
+    std::string placement, side;
+    iss >> placement >> side;
+    return std::count(placement.begin(), placement.end(), '/') == 7 && (side == "w" || side == "b");
+}
+
+// The number of the last move in the solution is the mate length
+int mate_length(const std::string& solution) {
+    std::istringstream iss(solution);
+    std::string token;
+    int last = 0;
+    while (iss >> token) {
+        if (!token.empty() && std::isdigit(static_cast<unsigned char>(token[0])) && token.find('.') != std::string::npos) {
+            last = std::stoi(token);
+        }
+    }
+    return last;
+}
+
+std::vector<Puzzle> read_puzzles(const std::string& path) {
+    std::ifstream in(path);
+    std::vector<Puzzle> puzzles;
+    std::string line, previous;
+    bool pending = false;
+
+    while (std::getline(in, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (pending) {
+            int mate_in = mate_length(line);
+            if (mate_in > 0) puzzles.push_back({previous, line, mate_in});
+            pending = false;
+        } else if (looks_like_fen(line)) {
+            previous = line;
+            pending = true;
+        }
+    }
+    return puzzles;
+}
+
+// First solution move without the move number and check marks
+std::string first_solution_move(const std::string& solution) {
+    std::istringstream iss(solution);
+    std::string token;
+    while (iss >> token) {
+        if (std::isdigit(static_cast<unsigned char>(token[0]))) continue;
+        token.erase(std::remove_if(token.begin(), token.end(), [](char c) { return c == '+' || c == '#'; }), token.end());
+        return token;
+    }
+    return "";
+}
+
+std::vector<std::string> san_line(const std::vector<Move>& moves, const std::string& fen) {
+    Board board(fen);
+    std::vector<std::string> sans;
+    for (const auto& move : moves) {
+        sans.push_back(uci::moveToSan(board, move));
+        board.makeMove(move);
+    }
+    return sans;
+}
+
+// ./check_mate_in_n --batch <puzzles.txt> [threads] [--pns]
+// Solves every puzzle in the file on a pool of threads, each with its own
+// solver and tables, and compares the first move with the given solution.
+int run_batch(const std::string& path, int threads, bool use_pns) {
+    std::vector<Puzzle> puzzles = read_puzzles(path);
+    if (puzzles.empty()) {
+        std::cerr << "No puzzles found in " << path << std::endl;
+        return 1;
+    }
+
+    std::vector<PuzzleResult> results(puzzles.size());
+    std::atomic<std::size_t> next{0};
+    auto start = std::chrono::steady_clock::now();
+
+    auto worker = [&] {
+        auto solver = std::make_unique<MateSolver>();
+        std::vector<Move> line;
+        for (std::size_t i = next++; i < puzzles.size(); i = next++) {
+            const Puzzle& puzzle = puzzles[i];
+            int depth = std::min(2 * puzzle.mate_in - 1, MAX_MATE_PLY - 1);
+            auto puzzle_start = std::chrono::steady_clock::now();
+            int value = use_pns ? solver->solve_pns(puzzle.fen, depth, line)
+                                : solver->solve(puzzle.fen, depth, line);
+
+            PuzzleResult& result = results[i];
+            result.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - puzzle_start).count();
+            result.nodes = solver->node_count();
+            result.solved = value == 1;
+            for (const auto& san : san_line(line, puzzle.fen)) {
+                result.line += (result.line.empty() ? "" : " ") + san;
+            }
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (int i = 0; i < threads; ++i) {
+        pool.emplace_back(worker);
+    }
+    for (auto& thread : pool) {
+        thread.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    int solved = 0, matching = 0;
+    std::uint64_t total_nodes = 0;
+    for (std::size_t i = 0; i < puzzles.size(); ++i) {
+        const PuzzleResult& result = results[i];
+        std::string first = result.line.substr(0, result.line.find(' '));
+        first.erase(std::remove_if(first.begin(), first.end(), [](char c) { return c == '+' || c == '#'; }), first.end());
+        bool match = result.solved && first == first_solution_move(puzzles[i].solution);
+
+        solved += result.solved;
+        matching += match;
+        total_nodes += result.nodes;
+        std::cout << "Puzzle " << i + 1 << ": " << (match ? "ok  " : result.solved ? "alt " : "FAIL")
+                  << " nodes " << result.nodes << " time " << static_cast<int>(result.ms) << "ms  "
+                  << (result.solved ? result.line : "no mate found") << std::endl;
+    }
+
+    std::cout << "===========================" << std::endl;
+    std::cout << "Solved        : " << solved << "/" << puzzles.size() << std::endl;
+    std::cout << "Solution match: " << matching << "/" << puzzles.size() << std::endl;
+    std::cout << "Total nodes   : " << total_nodes << std::endl;
+    std::cout << "Time (ms)     : " << static_cast<std::uint64_t>(seconds * 1000) << std::endl;
+    std::cout << "Nodes/second  : " << static_cast<std::uint64_t>(total_nodes / std::max(seconds, 1e-9)) << std::endl;
+    return solved == static_cast<int>(puzzles.size()) ? 0 : 1;
+}
+
+// ./check_mate_in_n --check-table <puzzles.txt>
+// Regression check for MateTable reuse across depths: for every mate in N,
+// warms a solver's table at 2N-1 plies and then solves the same puzzle at
+// 2N-3, which must give the same answer as a fresh solver.
+int run_table_check(const std::string& path) {
+    std::vector<Puzzle> puzzles = read_puzzles(path);
+    if (puzzles.empty()) {
+        std::cerr << "No puzzles found in " << path << std::endl;
+        return 1;
+    }
+
+    int checked = 0, failed = 0;
+    std::vector<Move> line;
+    for (std::size_t i = 0; i < puzzles.size(); ++i) {
+        const Puzzle& puzzle = puzzles[i];
+        int depth = std::min(2 * puzzle.mate_in - 1, MAX_MATE_PLY - 1);
+        if (depth < 3) continue;
+
+        auto fresh = std::make_unique<MateSolver>();
+        int expected = fresh->solve(puzzle.fen, depth - 2, line);
+
+        auto warmed = std::make_unique<MateSolver>();
+        warmed->solve(puzzle.fen, depth, line);
+        int value = warmed->solve(puzzle.fen, depth - 2, line);
+
+        ++checked;
+        if (value != expected) {
+            ++failed;
+            std::cout << "Puzzle " << i + 1 << ": FAIL depth " << depth - 2 << " gives " << value
+                      << " after depth " << depth << ", " << expected << " from a fresh table" << std::endl;
+        }
+    }
+
+    std::cout << "Table check: " << checked - failed << "/" << checked << " consistent" << std::endl;
+    return failed == 0 ? 0 : 1;
+}
+
 int main(int argc, char* argv[]) {
-    if (argc != 3) {
-        std::cerr << "Usage: " << argv[0] << " <fen_string> <depth>" << std::endl;
+    if (argc >= 3 && std::string(argv[1]) == "--batch") {
+        int threads = std::max(1u, std::thread::hardware_concurrency());
+        bool use_pns = false;
+        for (int i = 3; i < argc; ++i) {
+            if (std::string(argv[i]) == "--pns") use_pns = true;
+            else threads = std::max(1, std::stoi(argv[i]));
+        }
+        return run_batch(argv[2], threads, use_pns);
+    }
+    if (argc == 3 && std::string(argv[1]) == "--check-table") {
+        return run_table_check(argv[2]);
+    }
+
+    bool use_pns = argc == 4 && std::string(argv[1]) == "--pns";
+    if (argc != 3 && !use_pns) {
+        std::cerr << "Usage: " << argv[0] << " [--pns] <fen_string> <depth>" << std::endl;
+        std::cerr << "       " << argv[0] << " --batch <puzzles.txt> [threads] [--pns]" << std::endl;
+        std::cerr << "       " << argv[0] << " --check-table <puzzles.txt>" << std::endl;
         return 1;
     }
 
-    std::string fen = argv[1];
-    int depth = std::stoi(argv[2]);
+    std::string fen = argv[argc - 2];
+    int depth = std::stoi(argv[argc - 1]);
+    if (depth < 1 || depth >= MAX_MATE_PLY) {
+        std::cerr << "Depth must be between 1 and " << MAX_MATE_PLY - 1 << std::endl;
+        return 1;
+    }
 
     Board initial_board(fen);
-    auto [value, winning_moves] = solve_mate_in_n(fen, depth);
+    auto solver = std::make_unique<MateSolver>();
+    std::vector<Move> winning_moves;
+    int value = use_pns ? solver->solve_pns(fen, depth, winning_moves)
+                        : solver->solve(fen, depth, winning_moves);
     
-    if (value == 1 || value == -1) {
+    if (value == 1) {
         print_moves(winning_moves, initial_board);
     } else {
         std::cout << "No mate found within " << depth << " moves" << std::endl;